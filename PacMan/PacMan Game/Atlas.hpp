@@ -0,0 +1,33 @@
+// generated by pack_atlas, do not edit
+#pragma once
+
+#include <SFML/Graphics/Rect.hpp>
+
+const unsigned short ATLAS_WIDTH = 768;
+const unsigned short ATLAS_HEIGHT = 95;
+const unsigned char ATLAS_SHEET_COUNT = 6;
+
+const sf::IntRect ATLAS_MAP16(192, 0, 256, 32);
+const sf::IntRect ATLAS_GHOST16(96, 0, 96, 48);
+const sf::IntRect ATLAS_PACMAN16(0, 0, 96, 64);
+const sf::IntRect ATLAS_PACMANDEATH16(448, 0, 192, 16);
+const sf::IntRect ATLAS_FONT(0, 64, 768, 16);
+const sf::IntRect ATLAS_HEART(0, 80, 51, 15);
+
+const char* const ATLAS_SHEET_FILES[ATLAS_SHEET_COUNT] = {
+   "Resources/Images/Map16.png",
+   "Resources/Images/Ghost16.png",
+   "Resources/Images/Pacman16.png",
+   "Resources/Images/PacmanDeath16.png",
+   "Resources/Images/Font.png",
+   "Resources/Images/Heart.png",
+};
+
+const sf::IntRect ATLAS_SHEET_RECTS[ATLAS_SHEET_COUNT] = {
+   ATLAS_MAP16,
+   ATLAS_GHOST16,
+   ATLAS_PACMAN16,
+   ATLAS_PACMANDEATH16,
+   ATLAS_FONT,
+   ATLAS_HEART,
+};
@@ -1,42 +1,69 @@
 #include <array>
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <climits>
+#include <cstdio>
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <deque>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
 #include <SFML/Graphics.hpp>
 #include <SFML/Audio.hpp>
+#include <SFML/Network.hpp>
 #include <iostream>
 #include <fstream>
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#define WALL_PROBE_AVX2
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__)
+#define TILE_BLIT_SSE2
+#include <emmintrin.h>
+#endif
+#include "Atlas.hpp"
 
 using namespace std;
 using namespace sf;
 
 // sized and speed and map height timing and declared here 
 constexpr unsigned char CELL_SIZE = 16;
+// positions are whole pixels, speeds and the distance carried between ticks have 8 fractional bits
+constexpr unsigned char FIXED_SHIFT = 8;
 constexpr unsigned char FONT_HEIGHT = 16;
 constexpr unsigned char GHOST_1_CHASE = 2;
 constexpr unsigned char GHOST_2_CHASE = 1;
 constexpr unsigned char GHOST_3_CHASE = 4;
 constexpr unsigned char GHOST_ANIMATION_FRAMES = 6;
 constexpr unsigned char GHOST_ANIMATION_SPEED = 4;
-constexpr unsigned char GHOST_ESCAPE_SPEED = 4;
-constexpr unsigned char GHOST_FRIGHTENED_SPEED = 3;
-constexpr unsigned char GHOST_SPEED = 1;
 constexpr unsigned char MAP_HEIGHT = 21;
 constexpr unsigned char MAP_WIDTH = 21;
 constexpr unsigned char PACMAN_ANIMATION_FRAMES = 6;
 constexpr unsigned char PACMAN_ANIMATION_SPEED = 4;
 constexpr unsigned char PACMAN_DEATH_FRAMES = 12;
-constexpr unsigned char PACMAN_SPEED = 2;
 constexpr unsigned char SCREEN_RESIZE = 2;
 
 constexpr unsigned short CHASE_DURATION = 1024;
 constexpr unsigned short ENERGIZER_DURATION = 512;
+constexpr unsigned short FIXED_ONE = 1 << FIXED_SHIFT;
 constexpr unsigned short FRAME_DURATION = 16667;
+constexpr unsigned short GHOST_ESCAPE_SPEED = 4 * FIXED_ONE;
 constexpr unsigned short GHOST_FLASH_START = 64;
+constexpr unsigned short GHOST_FRIGHTENED_SPEED = FIXED_ONE / 4;
+constexpr unsigned short GHOST_SPEED = FIXED_ONE;
 constexpr unsigned short LONG_SCATTER_DURATION = 512;
+// frames drawn between ticks are capped at 240 Hz
+constexpr unsigned short MIN_DRAW_DURATION = 4167;
+constexpr unsigned short PACMAN_SPEED = 2 * FIXED_ONE;
 constexpr unsigned short SHORT_SCATTER_DURATION = 256;
 // for the map 
 enum Cell
@@ -61,29 +88,195 @@ struct Position
 };
 
 
+// body colours by ghost id, ghosts past the fourth reuse them in order
+constexpr unsigned char GHOST_COLOR_COUNT = 4;
+const Color GHOST_COLORS[GHOST_COLOR_COUNT] = {Color(255, 0, 0), Color(255, 182, 255), Color(0, 255, 255), Color(255, 182, 85)};
+
+
 class Pacman;
-class Ghost;
 class GhostManager;
 
 bool map_collision(bool collect_pellets, bool use_door, short x, short y, array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map);
 
-// queue implementation for bfs path finding
+// queue implementation for bfs path finding, also the single-threaded ring everything else starts from.
+// One slot always stays empty so a full ring can be told from an empty one, push fails when full
 template<typename T, size_t SIZE>
 class SimpleQueue {
     T data[SIZE];
     size_t front, back;
 public:
     SimpleQueue() : front(0), back(0) {}
-    void push(const T& value) {
-        data[back++] = value;
-        if(back == SIZE) back = 0;
+    bool push(const T& value) {
+        size_t next = back + 1 == SIZE ? 0 : back + 1;
+        if (next == front) return false;
+        data[back] = value;
+        back = next;
+        return true;
+    }
+    // as many of the values as fit, returns how many went in
+    size_t push(const T* values, size_t count) {
+        size_t pushed = 0;
+        while (pushed < count && push(values[pushed])) ++pushed;
+        return pushed;
     }
     void pop() {
         ++front;
         if(front == SIZE) front = 0;
     }
+    // up to count values into values, returns how many came out
+    size_t pop(T* values, size_t count) {
+        size_t popped = 0;
+        for (; popped < count && !empty(); ++popped) {
+            values[popped] = data[front];
+            pop();
+        }
+        return popped;
+    }
     T& top() { return data[front]; }
     bool empty() const { return front == back; }
+    bool full() const { return (back + 1 == SIZE ? 0 : back + 1) == front; }
+    size_t size() const { return back >= front ? back - front : SIZE - front + back; }
+};
+
+constexpr size_t CACHE_LINE_SIZE = 64;
+
+// the same ring for one producer thread and one consumer thread, without locks. Each side's index
+// sits on its own cache line with its copy of the other side's index, so the lines only travel
+// between cores when a side thinks it ran out of room or items
+template<typename T, size_t SIZE>
+class SpscQueue {
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> back;
+    size_t cached_front;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> front;
+    size_t cached_back;
+    alignas(CACHE_LINE_SIZE) T data[SIZE];
+
+    static size_t next(size_t index) { return index + 1 == SIZE ? 0 : index + 1; }
+
+public:
+    SpscQueue() : back(0), cached_front(0), front(0), cached_back(0) {}
+
+    // producer side
+    bool push(const T& value) {
+        size_t index = back.load(std::memory_order_relaxed);
+        if (next(index) == cached_front) {
+            cached_front = front.load(std::memory_order_acquire);
+            if (next(index) == cached_front) return false;
+        }
+        data[index] = value;
+        back.store(next(index), std::memory_order_release);
+        return true;
+    }
+
+    // one release for the whole batch, returns how many went in
+    size_t push(const T* values, size_t count) {
+        size_t index = back.load(std::memory_order_relaxed);
+        size_t room = (cached_front + SIZE - index - 1) % SIZE;
+        if (room < count) {
+            cached_front = front.load(std::memory_order_acquire);
+            room = (cached_front + SIZE - index - 1) % SIZE;
+        }
+        size_t pushed = std::min(room, count);
+        for (size_t i = 0; i < pushed; ++i) {
+            data[index] = values[i];
+            index = next(index);
+        }
+        back.store(index, std::memory_order_release);
+        return pushed;
+    }
+
+    // consumer side
+    bool pop(T& value) {
+        size_t index = front.load(std::memory_order_relaxed);
+        if (index == cached_back) {
+            cached_back = back.load(std::memory_order_acquire);
+            if (index == cached_back) return false;
+        }
+        value = data[index];
+        front.store(next(index), std::memory_order_release);
+        return true;
+    }
+
+    size_t pop(T* values, size_t count) {
+        size_t index = front.load(std::memory_order_relaxed);
+        size_t ready = (cached_back + SIZE - index) % SIZE;
+        if (ready < count) {
+            cached_back = back.load(std::memory_order_acquire);
+            ready = (cached_back + SIZE - index) % SIZE;
+        }
+        size_t popped = std::min(ready, count);
+        for (size_t i = 0; i < popped; ++i) {
+            values[i] = data[index];
+            index = next(index);
+        }
+        front.store(index, std::memory_order_release);
+        return popped;
+    }
+
+    bool empty() const { return front.load(std::memory_order_acquire) == back.load(std::memory_order_acquire); }
+};
+
+// any number of producer threads and one consumer, without locks. Producers claim a slot by moving
+// back along with a compare-exchange, and every slot carries a sequence number that says whether it
+// is free for the lap a producer is on or holds a value for the consumer's lap
+template<typename T, size_t SIZE>
+class MpscQueue {
+    static_assert(SIZE && 0 == (SIZE & (SIZE - 1)), "the slot index is masked out of the position");
+
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> back;
+    alignas(CACHE_LINE_SIZE) size_t front;
+    alignas(CACHE_LINE_SIZE) Slot slots[SIZE];
+
+public:
+    MpscQueue() : back(0), front(0) {
+        for (size_t i = 0; i < SIZE; ++i) slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // any thread
+    bool push(const T& value) {
+        size_t position = back.load(std::memory_order_relaxed);
+        Slot* slot;
+        while (true) {
+            slot = &slots[position & (SIZE - 1)];
+            ptrdiff_t lap = static_cast<ptrdiff_t>(slot->sequence.load(std::memory_order_acquire)) - static_cast<ptrdiff_t>(position);
+            if (lap == 0) {
+                if (back.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+            }
+            // the consumer has not freed this slot from the last lap yet
+            else if (lap < 0) return false;
+            else position = back.load(std::memory_order_relaxed);
+        }
+        slot->value = value;
+        slot->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t push(const T* values, size_t count) {
+        size_t pushed = 0;
+        while (pushed < count && push(values[pushed])) ++pushed;
+        return pushed;
+    }
+
+    // consumer only, a slot still being written ends the pop even if later ones are ready
+    bool pop(T& value) {
+        Slot& slot = slots[front & (SIZE - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != front + 1) return false;
+        value = std::move(slot.value);
+        slot.sequence.store(front + SIZE, std::memory_order_release);
+        ++front;
+        return true;
+    }
+
+    size_t pop(T* values, size_t count) {
+        size_t popped = 0;
+        while (popped < count && pop(values[popped])) ++popped;
+        return popped;
+    }
 };
 
 // Stack implementation for pause/resume functionality
@@ -108,2076 +301,7336 @@ public:
     size_t size() const { return top_index; }
 };
 
-// using the bfs for pathfinding for ghost and also impemented the queue class for bfs
- // (0:right,1:up,2:left,3:down)
- 
-
-int bfs_next_direction(
-    const array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map,
-    Position start,
-    Position goal
-) {
-    // Convert pixel positions to grid cells
-    int start_x = start.x / CELL_SIZE;
-    int start_y = start.y / CELL_SIZE;
-    int goal_x  = goal.x / CELL_SIZE;
-    int goal_y  = goal.y / CELL_SIZE;
-
-    static const int dx[4] = {1, 0, -1, 0};
-    static const int dy[4] = {0,-1,  0, 1};
-    bool visited[MAP_WIDTH][MAP_HEIGHT] = {};
-    int  parent_dir[MAP_WIDTH][MAP_HEIGHT] = {};
-
-    SimpleQueue<pair<int,int>, MAP_WIDTH * MAP_HEIGHT> q;
-    q.push({start_x, start_y});
-    visited[start_x][start_y] = true;
+// resources packed by pack_assets and linked into the executable, see MakeFile
+extern const unsigned char ASSET_BUNDLE[];
+extern const size_t ASSET_BUNDLE_SIZE;
 
-    while (!q.empty()) {
-        pair<int, int> current = q.top();
-        q.pop();
-        int x = current.first;
-        int y = current.second;
-        if (x == goal_x && y == goal_y) break;
-        for (int dir = 0; dir < 4; ++dir) {
-            int nx = x + dx[dir];
-            int ny = y + dy[dir];
-            if (nx < 0 || nx >= MAP_WIDTH || ny < 0 || ny >= MAP_HEIGHT) continue;
-            if (map[nx][ny] == Wall) continue;
-            if (visited[nx][ny]) continue;
-            visited[nx][ny] = true;
-            parent_dir[nx][ny] = (dir + 2) % 4;
-            q.push({nx, ny});
-        }
-    }
-    int x = goal_x, y = goal_y;
-    if (!visited[x][y]) return -1; // this return -1 for No path
-    vector<int> path_dirs;
-    while (!(x == start_x && y == start_y)) {
-        int dir = parent_dir[x][y];
-        path_dirs.push_back((dir + 2) % 4);
-        x += dx[dir];
-        y += dy[dir];
-    }
-    return path_dirs.empty() ? -1 : path_dirs.back();
-}
-//pacman class for direction and position locat
-class Pacman
+// index over a pack_assets blob, either the linked one or a Resources.pak read in one go
+class AssetBundle
 {
-   bool animation_over;
-   bool dead;
-   unsigned char direction;
-   unsigned short animation_timer;
-   unsigned short energizer_timer;
-   Position position;
+   std::map<string, pair<const unsigned char*, size_t>> entries;
+   vector<unsigned char> pack_file;
+
+   static Uint32 read_u32(const unsigned char* data)
+   {
+      return data[0] | data[1] << 8 | data[2] << 16 | static_cast<Uint32>(data[3]) << 24;
+   }
 
 public:
-   Pacman();
+   bool open(const unsigned char* data, size_t size)
+   {
+      entries.clear();
 
-   bool get_animation_over();
-   bool get_dead();
-   unsigned char get_direction();
-   unsigned short get_energizer_timer();
+      if (size < 8 || 0 != memcmp(data, "PMPK", 4))
+      {
+         return 0;
+      }
 
-   void draw(bool victory, RenderWindow& window);
-   void reset();
-   void set_animation_timer(unsigned short value);
-   void set_dead(bool value);
-   void set_position(short x, short y);
-   void update(unsigned char level, array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map, int& score, sf::Sound& chompSound);
+      Uint32 count = read_u32(data + 4);
+      size_t at = 8;
 
-   Position get_position();
-};
+      for (Uint32 a = 0; a < count; a++)
+      {
+         if (at + 4 > size) return 0;
+         Uint32 name_length = read_u32(data + at);
+         if (at + 12 + name_length > size) return 0;
 
-//ghost class used for here with position and target and direction providing using bfs
-class Ghost
-{
-   bool movement_mode;
-   bool use_door;
-   unsigned char direction;
-   unsigned char frightened_mode;
-   unsigned char frightened_speed_timer;
-   unsigned char id;
-   unsigned short animation_timer;
-   Position home;
-   Position home_exit;
-   Position position;
-   Position target;
+         string name(reinterpret_cast<const char*>(data + at + 4), name_length);
+         Uint32 offset = read_u32(data + at + 4 + name_length);
+         Uint32 length = read_u32(data + at + 8 + name_length);
+         if (static_cast<size_t>(offset) + length > size) return 0;
 
-public:
-   explicit Ghost(unsigned char ghost_id);
+         entries[name] = {data + offset, length};
+         at += 12 + name_length;
+      }
 
-   bool pacman_collision(const Position& pacman_position);
-   float get_target_distance(unsigned char direction_override);
+      return 1;
+   }
 
-   void draw(bool flash, RenderWindow& window);
-   void reset(const Position& in_home, const Position& in_home_exit);
-   void set_position(short x, short y);
-   void switch_mode();
-   void update(unsigned char level, array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map, Ghost& ghost0, Pacman& pacman);
-   void update_target(unsigned char pacman_direction, const Position& ghost0_position, const Position& pacman_position);
+   bool open_file(const string& path)
+   {
+      ifstream ifs(path, ios::binary);
+      if (!ifs.is_open())
+      {
+         return 0;
+      }
 
-   Position get_position();
-};
+      pack_file.assign(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+      return open(pack_file.data(), pack_file.size());
+   }
 
-// managing the ghost mananger 4 ghost ko create kre ga
-class GhostManager
-{
-   unsigned char current_wave;
-   unsigned short wave_timer;
-   array<Ghost, 4> ghosts;
+   bool find(const string& file, const void*& data, size_t& size) const
+   {
+      std::map<string, pair<const unsigned char*, size_t>>::const_iterator it = entries.find(file);
 
-public:
-   GhostManager();
+      if (entries.end() == it)
+      {
+         return 0;
+      }
 
-   void draw(bool flash, RenderWindow& window);
-   void reset(unsigned char level, const array<Position, 4>& ghost_positions);
-   void update(unsigned char level, array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map, Pacman& pacman);
-};
+      data = it->second.first;
+      size = it->second.second;
+      return 1;
+   }
 
-array<array<Cell, MAP_HEIGHT>, MAP_WIDTH> convert_sketch(const array<string, MAP_HEIGHT>& map_sketch, array<Position, 4>& ghost_positions, Pacman& pacman);
-void draw_map(const array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map, RenderWindow& window);
-void draw_text(bool center, unsigned short x, unsigned short y, const string& text, RenderWindow& window);
-void draw_lives_hearts(unsigned char lives, RenderWindow& window);
+   size_t size() const { return entries.size(); }
+};
 
+// files missing from the bundle still load from disk
+AssetBundle asset_bundle;
 
-// Pacman implementation there 
-Pacman::Pacman() :
-   animation_over(0),
-   dead(0),
-   direction(0),
-   animation_timer(0),
-   energizer_timer(0),
-   position({0, 0})
+bool load_image(Image& image, const string& file)
 {
+   const void* data;
+   size_t size;
+   return asset_bundle.find(file, data, size) ? image.loadFromMemory(data, size) : image.loadFromFile(file);
 }
 
-bool Pacman::get_animation_over()
+bool load_texture(Texture& texture, const string& file)
 {
-   return animation_over;
+   const void* data;
+   size_t size;
+   return asset_bundle.find(file, data, size) ? texture.loadFromMemory(data, size) : texture.loadFromFile(file);
 }
 
-bool Pacman::get_dead()
+bool open_sound_file(InputSoundFile& sound, const string& file)
 {
-   return dead;
+   const void* data;
+   size_t size;
+   return asset_bundle.find(file, data, size) ? sound.openFromMemory(data, size) : sound.openFromFile(file);
 }
 
-unsigned char Pacman::get_direction()
+bool open_music(Music& music, const string& file)
 {
-   return direction;
+   const void* data;
+   size_t size;
+   return asset_bundle.find(file, data, size) ? music.openFromMemory(data, size) : music.openFromFile(file);
 }
 
-unsigned short Pacman::get_energizer_timer()
+bool load_sound_buffer(SoundBuffer& buffer, const string& file)
 {
-   return energizer_timer;
+   const void* data;
+   size_t size;
+   return asset_bundle.find(file, data, size) ? buffer.loadFromMemory(data, size) : buffer.loadFromFile(file);
 }
 
-void Pacman::draw(bool victory, RenderWindow& window)
+// startup timeline, written to startup.log so time-to-first-frame can be tracked
+class StartupTimeline
 {
-   unsigned char frame = static_cast<unsigned char>(floor(animation_timer / static_cast<float>(PACMAN_ANIMATION_SPEED)));
+   Clock clock;
+   Mutex mutex;
+   ofstream log;
 
-Sprite sprite;
-Texture texture;
+public:
+   StartupTimeline() : log("startup.log") {}
 
-   sprite.setPosition(position.x, position.y);
+   // safe to call from the loader threads
+   void mark(const string& what)
+   {
+      Lock lock(mutex);
+      log << clock.getElapsedTime().asMicroseconds() / 1000.f << " ms  " << what << '\n';
+   }
 
-   if (dead || victory)
+   Int32 elapsed_ms() const { return clock.getElapsedTime().asMilliseconds(); }
+};
+
+// SFML registers its sound file readers lazily and that is not thread safe,
+// so every sound file open goes through this lock
+Mutex sound_file_mutex;
+
+// decodes images and sounds on worker threads, the main thread uploads them as they finish
+class AssetLoader
+{
+   struct Job
    {
-      if (animation_timer < PACMAN_DEATH_FRAMES * PACMAN_ANIMATION_SPEED)
-      {
-         animation_timer++;
+      string file;
+      bool sound = 0;
+      float max_seconds = 0; // sounds only, 0 decodes the whole file
+      bool ok = 0;
+      bool uploaded = 0;
+      std::atomic<bool> decoded{0};
+      Image image;
+      vector<Int16> samples;
+      unsigned channels = 0;
+      unsigned sample_rate = 0;
+   };
+
+   StartupTimeline& timeline;
+   vector<unique_ptr<Job>> jobs;
+   std::map<string, size_t> index;
+   std::atomic<size_t> next_job;
+   unsigned uploaded;
+   vector<unique_ptr<Thread>> workers;
 
-         texture.loadFromFile("Resources/Images/PacmanDeath" + to_string(CELL_SIZE) + ".png");
+public:
+   explicit AssetLoader(StartupTimeline& in_timeline) : timeline(in_timeline), next_job(0), uploaded(0) {}
+   ~AssetLoader() { next_job = jobs.size(); }
 
-         sprite.setTexture(texture);
-         sprite.setTextureRect(IntRect(CELL_SIZE * frame, 0, CELL_SIZE, CELL_SIZE));
+   void add_image(const string& file) { add(file, 0, 0); }
+   void add_sound(const string& file, float max_seconds) { add(file, 1, max_seconds); }
 
-         window.draw(sprite);
+   void start(unsigned thread_count)
+   {
+      for (unsigned a = 0; a < thread_count; a++)
+      {
+         workers.emplace_back(new Thread(&AssetLoader::work, this));
+         workers.back()->launch();
       }
-      else
+   }
+
+   // main thread, once per loop, returns 1 when something new reached the caches
+   bool upload_ready()
+   {
+      bool any = 0;
+
+      for (unique_ptr<Job>& job : jobs)
       {
-         animation_over = 1;
+         if (!job->uploaded && job->decoded)
+         {
+            upload(*job);
+            any = 1;
+         }
       }
+
+      return any;
    }
-   else
+
+   // waits for one file, returns 0 when the loader does not know it
+   bool finish(const string& file)
    {
-      texture.loadFromFile("Resources/Images/Pacman" + to_string(CELL_SIZE) + ".png");
+      std::map<string, size_t>::iterator it = index.find(file);
 
-      sprite.setTexture(texture);
-      sprite.setTextureRect(IntRect(CELL_SIZE * frame, CELL_SIZE * direction, CELL_SIZE, CELL_SIZE));
+      if (index.end() == it)
+      {
+         return 0;
+      }
 
-      window.draw(sprite);
+      Job& job = *jobs[it->second];
 
-      animation_timer = (1 + animation_timer) % (PACMAN_ANIMATION_FRAMES * PACMAN_ANIMATION_SPEED);
-   }
-}
+      while (!job.decoded)
+      {
+         sf::sleep(milliseconds(1));
+      }
 
-void Pacman::reset()
-{
-   animation_over = 0;
-   dead = 0;
-   direction = 0;
-   animation_timer = 0;
-   energizer_timer = 0;
-}
+      upload(job);
+      return 1;
+   }
 
-void Pacman::set_animation_timer(unsigned short value)
-{
-   animation_timer = value;
-}
+   bool done() const { return uploaded == jobs.size(); }
+   float progress() const { return jobs.empty() ? 1 : uploaded / static_cast<float>(jobs.size()); }
 
-void Pacman::set_dead(bool value)
-{
-   dead = value;
+private:
+   void add(const string& file, bool sound, float max_seconds)
+   {
+      index[file] = jobs.size();
+      jobs.emplace_back(new Job);
+      jobs.back()->file = file;
+      jobs.back()->sound = sound;
+      jobs.back()->max_seconds = max_seconds;
+   }
 
-   if (dead)
+   void work()
    {
-      animation_timer = 0;
+      for (size_t a = next_job++; a < jobs.size(); a = next_job++)
+      {
+         Job& job = *jobs[a];
+         Clock decode_clock;
+
+         if (job.sound)
+         {
+            Lock lock(sound_file_mutex);
+            InputSoundFile file;
+
+            if (open_sound_file(file, job.file))
+            {
+               Uint64 count = file.getSampleCount();
+
+               if (0 < job.max_seconds)
+               {
+                  count = min(count, static_cast<Uint64>(job.max_seconds * file.getSampleRate()) * file.getChannelCount());
+               }
+
+               job.samples.resize(static_cast<size_t>(count));
+               job.samples.resize(static_cast<size_t>(file.read(job.samples.data(), count)));
+               job.channels = file.getChannelCount();
+               job.sample_rate = file.getSampleRate();
+               job.ok = 1;
+            }
+         }
+         else
+         {
+            job.ok = load_image(job.image, job.file);
+         }
+
+         timeline.mark("decoded " + job.file + " in " + to_string(decode_clock.getElapsedTime().asMicroseconds()) + " us");
+         job.decoded = 1;
+      }
    }
-}
 
-void Pacman::set_position(short x, short y)
+   void upload(Job& job);
+};
+
+std::map<string, Texture>& texture_cache()
 {
-   position = {x, y};
+   static std::map<string, Texture> textures;
+   return textures;
 }
 
-void Pacman::update(unsigned char level, array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map, int& score, sf::Sound& chompSound)
+std::map<string, SoundBuffer>& sound_cache()
 {
-   array<bool, 4> walls{};
-   walls[0] = map_collision(0, 0, PACMAN_SPEED + position.x, position.y, map);
-   walls[1] = map_collision(0, 0, position.x, position.y - PACMAN_SPEED, map);
-   walls[2] = map_collision(0, 0, position.x - PACMAN_SPEED, position.y, map);
-   walls[3] = map_collision(0, 0, position.x, PACMAN_SPEED + position.y, map);
+   static std::map<string, SoundBuffer> sounds;
+   return sounds;
+}
 
-   if (Keyboard::isKeyPressed(Keyboard::Right) && !walls[0])
-   {
-      direction = 0;
-   }
-   if (Keyboard::isKeyPressed(Keyboard::Up) && !walls[1])
+// set by main() while the startup assets are in flight
+AssetLoader* asset_loader = nullptr;
+
+void AssetLoader::upload(Job& job)
+{
+   if (job.uploaded)
    {
-      direction = 1;
+      return;
    }
-   if (Keyboard::isKeyPressed(Keyboard::Left) && !walls[2])
+
+   if (job.sound)
    {
-      direction = 2;
+      SoundBuffer& buffer = sound_cache()[job.file];
+
+      if (job.ok)
+      {
+         buffer.loadFromSamples(job.samples.data(), job.samples.size(), job.channels, job.sample_rate);
+      }
+      vector<Int16>().swap(job.samples);
    }
-   if (Keyboard::isKeyPressed(Keyboard::Down) && !walls[3])
+   else
    {
-      direction = 3;
-   }
+      Texture& texture = texture_cache()[job.file];
 
-   if (!walls[direction])
-   {
-      switch (direction)
+      if (job.ok)
       {
-         case 0: position.x += PACMAN_SPEED; break;
-         case 1: position.y -= PACMAN_SPEED; break;
-         case 2: position.x -= PACMAN_SPEED; break;
-         case 3: position.y += PACMAN_SPEED; break;
+         texture.loadFromImage(job.image);
       }
+      job.image = Image();
    }
 
-   if (position.x <= -CELL_SIZE)
+   if (!job.ok)
    {
-      position.x = CELL_SIZE * MAP_WIDTH - PACMAN_SPEED;
+      std::cerr << "Failed to load " << job.file << ".\n";
    }
-   else if (position.x >= CELL_SIZE * MAP_WIDTH)
+
+   job.uploaded = 1;
+   uploaded++;
+   timeline.mark("uploaded " + job.file);
+
+   if (done())
    {
-      position.x = PACMAN_SPEED - CELL_SIZE;
+      timeline.mark("all startup assets ready");
    }
+}
 
-   
-   bool collected = false;
-   float cell_x = position.x / static_cast<float>(CELL_SIZE);
-   float cell_y = position.y / static_cast<float>(CELL_SIZE);
-   for (unsigned char a = 0; a < 4; a++)
+// textures are loaded once and stay alive for every screen of the process
+const Texture& get_texture(const string& file)
+{
+   std::map<string, Texture>& textures = texture_cache();
+   std::map<string, Texture>::iterator it = textures.find(file);
+
+   if (textures.end() == it)
    {
-      short cx = 0;
-      short cy = 0;
-      switch (a)
+      if (asset_loader && asset_loader->finish(file))
       {
-         case 0: cx = static_cast<short>(floor(cell_x)); cy = static_cast<short>(floor(cell_y)); break;
-         case 1: cx = static_cast<short>(ceil(cell_x)); cy = static_cast<short>(floor(cell_y)); break;
-         case 2: cx = static_cast<short>(floor(cell_x)); cy = static_cast<short>(ceil(cell_y)); break;
-         case 3: cx = static_cast<short>(ceil(cell_x)); cy = static_cast<short>(ceil(cell_y)); break;
+         return textures[file];
       }
-      if (0 <= cx && 0 <= cy && MAP_HEIGHT > cy && MAP_WIDTH > cx)
+
+      it = textures.emplace(file, Texture()).first;
+
+      if (!load_texture(it->second, file))
       {
-         if (map[cx][cy] == Cell::Energizer)
-         {
-            map[cx][cy] = Cell::Empty;
-            score += 50;
-            chompSound.play();
-         }
-         else if (map[cx][cy] == Cell::Pellet)
-         {
-            map[cx][cy] = Cell::Empty;
-            score += 10;
-            chompSound.play();
-         }
+         std::cerr << "Failed to load " << file << ".\n";
       }
    }
-}
 
-Position Pacman::get_position()
-{
-   return position;
+   return it->second;
 }
 
-// ghost implementation here
-Ghost::Ghost(unsigned char i_id) :
-   movement_mode(0),
-   use_door(0),
-   direction(0),
-   frightened_mode(0),
-   frightened_speed_timer(0),
-   id(i_id),
-   animation_timer(0),
-   home({0, 0}),
-   home_exit({0, 0}),
-   position({0, 0}),
-   target({0, 0})
+// same for sound buffers, music intros are cut to the length they were queued with
+const SoundBuffer& get_sound_buffer(const string& file)
 {
-}
+   std::map<string, SoundBuffer>& sounds = sound_cache();
+   std::map<string, SoundBuffer>::iterator it = sounds.find(file);
 
-bool Ghost::pacman_collision(const Position& pacman_position)
-{
-   if (position.x > pacman_position.x - CELL_SIZE && position.x < CELL_SIZE + pacman_position.x)
+   if (sounds.end() == it)
    {
-      if (position.y > pacman_position.y - CELL_SIZE && position.y < CELL_SIZE + pacman_position.y)
+      if (asset_loader && asset_loader->finish(file))
       {
-         return 1;
+         return sounds[file];
       }
-   }
 
-   return 0;
-}
-
-float Ghost::get_target_distance(unsigned char direction_override)
-{
-   short x = position.x;
-   short y = position.y;
+      it = sounds.emplace(file, SoundBuffer()).first;
 
-   switch (direction_override)
-   {
-      case 0: x += GHOST_SPEED; break;
-      case 1: y -= GHOST_SPEED; break;
-      case 2: x -= GHOST_SPEED; break;
-      case 3: y += GHOST_SPEED; break;
-      default: break;
+      Lock lock(sound_file_mutex);
+      if (!load_sound_buffer(it->second, file))
+      {
+         std::cerr << "Failed to load " << file << ".\n";
+      }
    }
 
-   return static_cast<float>(sqrt(pow(x - target.x, 2) + pow(y - target.y, 2)));
+   return it->second;
 }
 
-void Ghost::draw(bool flash, RenderWindow& window)
+// 1 once the file sits in the cache, so screens can draw without waiting for it
+bool texture_ready(const string& file)
 {
-   unsigned char body_frame = static_cast<unsigned char>(floor(animation_timer / static_cast<float>(GHOST_ANIMATION_SPEED)));
-
-Sprite body;
-Sprite face;
+   return texture_cache().count(file) > 0;
+}
 
-Texture texture;
-   texture.loadFromFile("Resources/Images/Ghost" + to_string(CELL_SIZE) + ".png");
+const string ATLAS_FILE = "Resources/Images/Atlas.png";
 
-   body.setTexture(texture);
-   body.setPosition(position.x, position.y);
-   body.setTextureRect(IntRect(CELL_SIZE * body_frame, 0, CELL_SIZE, CELL_SIZE));
+bool asset_exists(const string& file)
+{
+   const void* data;
+   size_t size;
+   return asset_bundle.find(file, data, size) || ifstream(file).is_open();
+}
 
-   face.setTexture(texture);
-   face.setPosition(position.x, position.y);
+// the sheets copied to where Atlas.hpp places them
+Image stitch_atlas()
+{
+   Image image;
+   image.create(ATLAS_WIDTH, ATLAS_HEIGHT, Color::Transparent);
 
-   if (0 == frightened_mode)
+   for (unsigned char a = 0; a < ATLAS_SHEET_COUNT; a++)
    {
-      switch (id)
+      Image sheet;
+
+      if (load_image(sheet, ATLAS_SHEET_FILES[a]))
+      {
+         image.copy(sheet, ATLAS_SHEET_RECTS[a].left, ATLAS_SHEET_RECTS[a].top);
+      }
+      else
       {
-         case 0: body.setColor(Color(255, 0, 0)); break;
-         case 1: body.setColor(Color(255, 182, 255)); break;
-         case 2: body.setColor(Color(0, 255, 255)); break;
-         case 3: body.setColor(Color(255, 182, 85)); break;
+         std::cerr << "Failed to load " << ATLAS_SHEET_FILES[a] << ".\n";
       }
+   }
+
+   return image;
+}
 
-      face.setTextureRect(IntRect(CELL_SIZE * direction, CELL_SIZE, CELL_SIZE, CELL_SIZE));
+// every sprite sheet in one texture, so a game frame binds a single texture.
+// Atlas.png comes from pack_atlas, without it the atlas is stitched here from the sheets
+const Texture& get_atlas()
+{
+   static Texture stitched;
+   static const Texture* atlas = nullptr;
 
-      window.draw(body);
-   }
-   else if (1 == frightened_mode)
+   if (!atlas)
    {
-      body.setColor(Color(36, 36, 255));
-      face.setTextureRect(IntRect(4 * CELL_SIZE, CELL_SIZE, CELL_SIZE, CELL_SIZE));
-
-      if (flash && 0 == body_frame % 2)
+      if (asset_exists(ATLAS_FILE))
       {
-         body.setColor(Color(255, 255, 255));
-         face.setColor(Color(255, 0, 0));
+         atlas = &get_texture(ATLAS_FILE);
       }
-      else
+
+      if (!atlas || atlas->getSize() != Vector2u(ATLAS_WIDTH, ATLAS_HEIGHT))
       {
-         body.setColor(Color(36, 36, 255));
-         face.setColor(Color(255, 255, 255));
+         stitched.loadFromImage(stitch_atlas());
+         atlas = &stitched;
       }
-
-      window.draw(body);
-   }
-   else
-   {
-      face.setTextureRect(IntRect(CELL_SIZE * direction, 2 * CELL_SIZE, CELL_SIZE, CELL_SIZE));
    }
 
-   window.draw(face);
-
-   animation_timer = (1 + animation_timer) % (GHOST_ANIMATION_FRAMES * GHOST_ANIMATION_SPEED);
+   return *atlas;
 }
 
-void Ghost::reset(const Position& in_home, const Position& in_home_exit)
+// a rect inside one sheet, moved to where that sheet sits in the atlas
+IntRect atlas_rect(const IntRect& sheet, int left, int top, int width, int height)
 {
-   movement_mode = 0;
-   use_door = 0 < id;
-   direction = 0;
-   frightened_mode = 0;
-   frightened_speed_timer = 0;
-   animation_timer = 0;
-   home = in_home;
-   home_exit = in_home_exit;
-   target = in_home_exit;
+   return IntRect(sheet.left + left, sheet.top + top, width, height);
 }
 
-void Ghost::set_position(short x, short y)
+// one textured quad out of the atlas, for code that batches its own vertices
+void append_quad(VertexArray& vertices, float x, float y, const IntRect& rect, const Color& color = Color::White)
 {
-   position = {x, y};
+   float width = static_cast<float>(rect.width);
+   float height = static_cast<float>(rect.height);
+   float u = static_cast<float>(rect.left);
+   float v = static_cast<float>(rect.top);
+
+   vertices.append(Vertex(Vector2f(x, y), color, Vector2f(u, v)));
+   vertices.append(Vertex(Vector2f(x + width, y), color, Vector2f(u + width, v)));
+   vertices.append(Vertex(Vector2f(x + width, y + height), color, Vector2f(u + width, v + height)));
+   vertices.append(Vertex(Vector2f(x, y + height), color, Vector2f(u, v + height)));
 }
 
-void Ghost::switch_mode()
+// actor quads collected over a frame so every ghost and Pac-Man go out in one draw call
+class SpriteBatch
 {
-   movement_mode = 1 - movement_mode;
-}
+   VertexArray vertices;
 
-void Ghost::update(unsigned char level, array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map, Ghost& ghost0, Pacman& pacman)
-{
-   bool move = 0;
-   unsigned char available_ways = 0;
-   unsigned char speed = GHOST_SPEED;
+public:
+   SpriteBatch() : vertices(Quads) {}
 
-   array<bool, 4> walls{};
+   // keeps the capacity, so a steady number of actors never reallocates
+   void clear() { vertices.clear(); }
 
-   if (0 == frightened_mode && pacman.get_energizer_timer() == ENERGIZER_DURATION / pow(2, level))
-   {
-      frightened_speed_timer = GHOST_FRIGHTENED_SPEED;
-      frightened_mode = 1;
-   }
-   else if (0 == pacman.get_energizer_timer() && 1 == frightened_mode)
+   void add(float x, float y, const IntRect& rect, const Color& color = Color::White)
    {
-      frightened_mode = 0;
+      append_quad(vertices, x, y, rect, color);
    }
 
-   if (2 == frightened_mode && 0 == position.x % GHOST_ESCAPE_SPEED && 0 == position.y % GHOST_ESCAPE_SPEED)
+   const VertexArray& get_vertices() const { return vertices; }
+
+   void draw(RenderTarget& window) const
    {
-      speed = GHOST_ESCAPE_SPEED;
+      window.draw(vertices, RenderStates(&get_atlas()));
    }
+};
 
-   update_target(pacman.get_direction(), ghost0.get_position(), pacman.get_position());
+// using the bfs for pathfinding for ghost and also impemented the queue class for bfs
+ // (0:right,1:up,2:left,3:down)
+ 
 
-   walls[0] = map_collision(0, use_door, speed + position.x, position.y, map);
-   walls[1] = map_collision(0, use_door, position.x, position.y - speed, map);
-   walls[2] = map_collision(0, use_door, position.x - speed, position.y, map);
-   walls[3] = map_collision(0, use_door, position.x, speed + position.y, map);
+int bfs_next_direction(
+    const array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map,
+    Position start,
+    Position goal
+) {
+    // Convert pixel positions to grid cells
+    int start_x = start.x / CELL_SIZE;
+    int start_y = start.y / CELL_SIZE;
+    int goal_x  = goal.x / CELL_SIZE;
+    int goal_y  = goal.y / CELL_SIZE;
 
-   if (1 != frightened_mode)
-   {
-      unsigned char optimal_direction = 4;
-      move = 1;
+    static const int dx[4] = {1, 0, -1, 0};
+    static const int dy[4] = {0,-1,  0, 1};
+    bool visited[MAP_WIDTH][MAP_HEIGHT] = {};
+    int  parent_dir[MAP_WIDTH][MAP_HEIGHT] = {};
 
-      for (unsigned char a = 0; a < 4; a++)
-      {
-         if (a == (2 + direction) % 4)
-         {
-            continue;
-         }
-         else if (!walls[a])
-         {
-            if (4 == optimal_direction)
-            {
-               optimal_direction = a;
-            }
+    SimpleQueue<pair<int,int>, MAP_WIDTH * MAP_HEIGHT> q;
+    q.push({start_x, start_y});
+    visited[start_x][start_y] = true;
+
+    while (!q.empty()) {
+        pair<int, int> current = q.top();
+        q.pop();
+        int x = current.first;
+        int y = current.second;
+        if (x == goal_x && y == goal_y) break;
+        for (int dir = 0; dir < 4; ++dir) {
+            int nx = x + dx[dir];
+            int ny = y + dy[dir];
+            if (nx < 0 || nx >= MAP_WIDTH || ny < 0 || ny >= MAP_HEIGHT) continue;
+            if (map[nx][ny] == Wall) continue;
+            if (visited[nx][ny]) continue;
+            visited[nx][ny] = true;
+            parent_dir[nx][ny] = (dir + 2) % 4;
+            q.push({nx, ny});
+        }
+    }
+    int x = goal_x, y = goal_y;
+    if (!visited[x][y]) return -1; // this return -1 for No path
+    vector<int> path_dirs;
+    while (!(x == start_x && y == start_y)) {
+        int dir = parent_dir[x][y];
+        path_dirs.push_back((dir + 2) % 4);
+        x += dx[dir];
+        y += dy[dir];
+    }
+    return path_dirs.empty() ? -1 : path_dirs.back();
+}
+// gameplay audio, the simulation only raises events and the mixer plays them once per frame
+enum AudioEvent
+{
+   PelletEaten,
+   EnergizerEaten
+};
 
-            available_ways++;
+constexpr unsigned char AUDIO_EVENT_COUNT = 2;
+constexpr unsigned char AUDIO_EVENTS_PER_FRAME = 4;
+constexpr unsigned char AUDIO_QUEUE_SIZE = 64;
+constexpr unsigned char AUDIO_VOICES = 8;
 
-            if (get_target_distance(a) < get_target_distance(optimal_direction))
-            {
-               optimal_direction = a;
-            }
-         }
-      }
+const array<const char*, 1> AUDIO_SOUND_FILES = {
+   "Resources/Music/pacman_chomp.wav"
+};
 
-      if (available_ways > 1)
-      {
-         direction = optimal_direction;
-      }
-      else
-      {
-         if (4 == optimal_direction)
-         {
-            direction = static_cast<unsigned char>((2 + direction) % 4);
-         }
-         else
-         {
-            direction = optimal_direction;
-         }
-      }
+struct AudioEventSettings
+{
+   unsigned char sound;
+   unsigned char priority;
+   unsigned char max_voices;
+   unsigned short min_interval; // milliseconds between two starts of the same event
+   float volume;
+};
+
+// one chomp keeps playing while pellets are eaten instead of restarting on every pellet
+const array<AudioEventSettings, AUDIO_EVENT_COUNT> AUDIO_EVENT_SETTINGS = {{
+   {0, 1, 1, 120, 100.f},
+   {0, 2, 2, 60, 100.f}
+}};
+
+// gameplay pushes and the mixer pops, lock free so the two can sit on different threads
+class AudioEventQueue
+{
+   SpscQueue<unsigned char, AUDIO_QUEUE_SIZE> events;
+
+public:
+   // drops the event when full, a lost chomp is better than overwriting the queue
+   void push(AudioEvent event)
+   {
+      events.push(static_cast<unsigned char>(event));
    }
-   else
+
+   // everything raised since the last call, up to count events
+   size_t pop(unsigned char* raised, size_t count)
    {
-      unsigned char random_direction = static_cast<unsigned char>(rand() % 4);
+      return events.pop(raised, count);
+   }
+};
 
-      if (0 == frightened_speed_timer)
-      {
-         move = 1;
-         frightened_speed_timer = GHOST_FRIGHTENED_SPEED;
+// fixed pool of voices, created once for the whole process
+class AudioMixer
+{
+   array<const SoundBuffer*, AUDIO_SOUND_FILES.size()> buffers;
+   array<Sound, AUDIO_VOICES> voices;
+   array<unsigned char, AUDIO_VOICES> voice_event;
+   array<Int32, AUDIO_EVENT_COUNT> last_start;
+   Clock clock;
 
-         for (unsigned char a = 0; a < 4; a++)
-         {
-            if (a == (2 + direction) % 4)
-            {
-               continue;
-            }
-            else if (!walls[a])
-            {
-               available_ways++;
-            }
-         }
+public:
+   AudioMixer();
 
-         if (available_ways > 0)
-         {
-            while (walls[random_direction] || random_direction == (2 + direction) % 4)
-            {
-               random_direction = static_cast<unsigned char>(rand() % 4);
-            }
+   void update(AudioEventQueue& queue);
+   void stop_all();
 
-            direction = random_direction;
-         }
-         else
-         {
-            direction = static_cast<unsigned char>((2 + direction) % 4);
-         }
-      }
-      else
-      {
-         frightened_speed_timer--;
-      }
+private:
+   bool play(unsigned char event, Int32 now);
+};
+
+AudioMixer::AudioMixer()
+{
+   for (unsigned char a = 0; a < AUDIO_SOUND_FILES.size(); a++)
+   {
+      buffers[a] = &get_sound_buffer(AUDIO_SOUND_FILES[a]);
    }
 
-   if (move)
+   for (unsigned char a = 0; a < AUDIO_EVENT_COUNT; a++)
    {
-      switch (direction)
-      {
-         case 0: position.x += speed; break;
-         case 1: position.y -= speed; break;
-         case 2: position.x -= speed; break;
-         case 3: position.y += speed; break;
-      }
+      last_start[a] = -AUDIO_EVENT_SETTINGS[a].min_interval;
+   }
 
-      if (position.x <= -CELL_SIZE)
-      {
-         position.x = CELL_SIZE * MAP_WIDTH - speed;
-      }
-      else if (position.x >= CELL_SIZE * MAP_WIDTH)
-      {
-         position.x = speed - CELL_SIZE;
-      }
+   voice_event.fill(AUDIO_EVENT_COUNT);
+}
+
+void AudioMixer::update(AudioEventQueue& queue)
+{
+   // events of the same kind raised during one frame only need one voice
+   array<bool, AUDIO_EVENT_COUNT> raised{};
+   array<unsigned char, AUDIO_QUEUE_SIZE> events;
+
+   for (size_t a = queue.pop(events.data(), events.size()), b = 0; b < a; b++)
+   {
+      raised[events[b]] = 1;
    }
 
-   if (pacman_collision(pacman.get_position()))
+   array<unsigned char, AUDIO_EVENT_COUNT> order;
+   unsigned char raised_count = 0;
+
+   for (unsigned char a = 0; a < AUDIO_EVENT_COUNT; a++)
    {
-      if (0 == frightened_mode)
+      if (raised[a])
       {
-         pacman.set_dead(1);
+         order[raised_count++] = a;
       }
-      else
+   }
+
+   sort(order.begin(), order.begin() + raised_count, [](unsigned char a, unsigned char b)
+   {
+      return AUDIO_EVENT_SETTINGS[a].priority > AUDIO_EVENT_SETTINGS[b].priority;
+   });
+
+   Int32 now = clock.getElapsedTime().asMilliseconds();
+   unsigned char started = 0;
+
+   for (unsigned char a = 0; a < raised_count && started < AUDIO_EVENTS_PER_FRAME; a++)
+   {
+      if (play(order[a], now))
       {
-         use_door = 1;
-         frightened_mode = 2;
-         target = home;
+         started++;
       }
    }
 }
 
-void Ghost::update_target(unsigned char pacman_direction, const Position& ghost0_position, const Position& pacman_position)
+bool AudioMixer::play(unsigned char event, Int32 now)
 {
-   if (use_door)
+   const AudioEventSettings& settings = AUDIO_EVENT_SETTINGS[event];
+
+   if (now - last_start[event] < settings.min_interval)
+   {
+      return 0;
+   }
+
+   unsigned char playing = 0;
+   unsigned char voice = AUDIO_VOICES;
+
+   for (unsigned char a = 0; a < AUDIO_VOICES; a++)
    {
-      if (position == target)
+      if (Sound::Stopped == voices[a].getStatus())
       {
-         if (home_exit == target)
-         {
-            use_door = 0;
-         }
-         else if (home == target)
+         voice_event[a] = AUDIO_EVENT_COUNT;
+
+         if (AUDIO_VOICES == voice)
          {
-            frightened_mode = 0;
-            target = home_exit;
+            voice = a;
          }
       }
+      else if (event == voice_event[a])
+      {
+         playing++;
+      }
    }
-   else
+
+   if (playing >= settings.max_voices)
    {
-      if (0 == movement_mode)
+      return 0;
+   }
+
+   // all voices busy, steal the one with the lowest priority below ours
+   if (AUDIO_VOICES == voice)
+   {
+      for (unsigned char a = 0; a < AUDIO_VOICES; a++)
       {
-         switch (id)
+         if (AUDIO_EVENT_SETTINGS[voice_event[a]].priority < settings.priority &&
+             (AUDIO_VOICES == voice || AUDIO_EVENT_SETTINGS[voice_event[a]].priority < AUDIO_EVENT_SETTINGS[voice_event[voice]].priority))
          {
-            case 0: target = {CELL_SIZE * (MAP_WIDTH - 1), 0}; break;
-            case 1: target = {0, 0}; break;
-            case 2: target = {CELL_SIZE * (MAP_WIDTH - 1), CELL_SIZE * (MAP_HEIGHT - 1)}; break;
-            case 3: target = {0, CELL_SIZE * (MAP_HEIGHT - 1)}; break;
+            voice = a;
          }
       }
-      else
-      {
-         switch (id)
-         {
-            case 0:
-            {
-               target = pacman_position;
-               break;
-            }
-            case 1:
-            {
-               target = pacman_position;
-
-               switch (pacman_direction)
-               {
-                  case 0: target.x += CELL_SIZE * GHOST_1_CHASE; break;
-                  case 1: target.y -= CELL_SIZE * GHOST_1_CHASE; break;
-                  case 2: target.x -= CELL_SIZE * GHOST_1_CHASE; break;
-                  case 3: target.y += CELL_SIZE * GHOST_1_CHASE; break;
-                  default: break;
-               }
-
-               break;
-            }
-            case 2:
-            {
-               target = pacman_position;
-
-               switch (pacman_direction)
-               {
-                  case 0: target.x += CELL_SIZE * GHOST_2_CHASE; break;
-                  case 1: target.y -= CELL_SIZE * GHOST_2_CHASE; break;
-                  case 2: target.x -= CELL_SIZE * GHOST_2_CHASE; break;
-                  case 3: target.y += CELL_SIZE * GHOST_2_CHASE; break;
-                  default: break;
-               }
 
-               target.x += target.x - ghost0_position.x;
-               target.y += target.y - ghost0_position.y;
-
-               break;
-            }
-            case 3:
-            {
-               if (CELL_SIZE * GHOST_3_CHASE <= sqrt(pow(position.x - pacman_position.x, 2) + pow(position.y - pacman_position.y, 2)))
-               {
-                  target = pacman_position;
-               }
-               else
-               {
-                  target = {0, CELL_SIZE * (MAP_HEIGHT - 1)};
-               }
-               break;
-            }
-         }
+      if (AUDIO_VOICES == voice)
+      {
+         return 0;
       }
    }
-}
-
-Position Ghost::get_position()
-{
-   return position;
-}
 
+   voices[voice].setBuffer(*buffers[settings.sound]);
+   voices[voice].setVolume(settings.volume);
+   voices[voice].play();
+   voice_event[voice] = event;
+   last_start[event] = now;
 
-GhostManager::GhostManager() :
-   current_wave(0),
-   wave_timer(LONG_SCATTER_DURATION),
-   ghosts({Ghost(0), Ghost(1), Ghost(2), Ghost(3)})
-{
+   return 1;
 }
 
-void GhostManager::draw(bool flash, RenderWindow& window)
+void AudioMixer::stop_all()
 {
-   for (Ghost& ghost : ghosts)
+   for (unsigned char a = 0; a < AUDIO_VOICES; a++)
    {
-      ghost.draw(flash, window);
+      voices[a].stop();
+      voice_event[a] = AUDIO_EVENT_COUNT;
    }
 }
 
-void GhostManager::reset(unsigned char level, const array<Position, 4>& ghost_positions)
+// music, every stream is opened once and reused by the lobby and the game
+enum MusicTrack
 {
-   current_wave = 0;
-   wave_timer = static_cast<unsigned short>(LONG_SCATTER_DURATION / pow(2, level));
+   LobbyTrack,
+   GameTrack,
+   DeathTrack
+};
 
-   for (unsigned char a = 0; a < 4; a++)
+constexpr unsigned char MUSIC_STREAM_COUNT = 2;
+constexpr float MUSIC_FADE_SECONDS = 0.4f;
+constexpr float MUSIC_INTRO_SECONDS = 2.f;
+constexpr float MUSIC_UNDERRUN_SECONDS = 0.1f;
+
+const array<const char*, MUSIC_STREAM_COUNT> MUSIC_STREAM_FILES = {
+   "Resources/Music/pacman_theme.wav",
+   "Resources/Music/pacman_death.wav"
+};
+
+struct MusicTrackSettings
+{
+   unsigned char stream;
+   bool loop;
+};
+
+const array<MusicTrackSettings, 3> MUSIC_TRACK_SETTINGS = {{
+   {0, 1},
+   {0, 1},
+   {1, 0}
+}};
+
+// sf::Music that keeps statistics about how fast its buffers are refilled
+class MusicStream : public Music
+{
+   std::atomic<unsigned> fills;
+   std::atomic<Int64> slowest_fill;
+
+public:
+   MusicStream() : fills(0), slowest_fill(0) {}
+
+   unsigned get_fills() const { return fills; }
+   Time get_slowest_fill() const { return microseconds(slowest_fill); }
+
+protected:
+   // runs on the SFML streaming thread
+   bool onGetData(Chunk& data) override
    {
-      ghosts[a].set_position(ghost_positions[a].x, ghost_positions[a].y);
+      Clock fill_clock;
+      bool more = Music::onGetData(data);
+      Int64 elapsed = fill_clock.getElapsedTime().asMicroseconds();
+
+      fills++;
+      if (elapsed > slowest_fill)
+      {
+         slowest_fill = elapsed;
+      }
+
+      return more;
    }
+};
 
-   for (Ghost& ghost : ghosts)
+class MusicManager
+{
+   // the intro is decoded into memory and plays while the stream catches up behind it
+   struct Channel
    {
-      ghost.reset(ghosts[2].get_position(), ghosts[0].get_position());
-   }
-}
+      MusicStream stream;
+      Sound intro;
+      Time intro_length;
+      Time primed_offset;
+      bool loaded = 0;
+      bool handoff = 0;
+      float intro_gain = 0;
+      float intro_target = 0;
+      float stream_gain = 0;
+      float stream_target = 0;
+      Time last_offset;
+   };
 
-void GhostManager::update(unsigned char level, array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map, Pacman& pacman)
+   array<Channel, MUSIC_STREAM_COUNT> channels;
+   int current;
+   bool paused;
+   unsigned underruns;
+   Clock frame_clock;
+
+public:
+   MusicManager();
+   ~MusicManager();
+
+   void pause();
+   void play(MusicTrack track);
+   void resume();
+   void stop();
+   void update();
+
+   unsigned get_underruns() const { return underruns; }
+
+private:
+   void prime(Channel& channel);
+};
+
+MusicManager::MusicManager() :
+   current(-1),
+   paused(0),
+   underruns(0)
 {
-   if (0 == pacman.get_energizer_timer())
+   for (unsigned char a = 0; a < MUSIC_STREAM_COUNT; a++)
    {
-      if (0 == wave_timer)
+      Channel& channel = channels[a];
+
+      bool opened;
       {
-         if (current_wave < 7)
-         {
-            current_wave++;
+         Lock lock(sound_file_mutex);
+         opened = open_music(channel.stream, MUSIC_STREAM_FILES[a]);
+      }
 
-            for (Ghost& ghost : ghosts)
-            {
-               ghost.switch_mode();
-            }
-         }
+      // the intro was queued with MUSIC_INTRO_SECONDS at startup
+      const SoundBuffer& intro_buffer = get_sound_buffer(MUSIC_STREAM_FILES[a]);
 
-         if (1 == current_wave % 2)
-         {
-            wave_timer = CHASE_DURATION;
-         }
-         else if (2 == current_wave)
-         {
-            wave_timer = static_cast<unsigned short>(LONG_SCATTER_DURATION / pow(2, level));
-         }
-         else
-         {
-            wave_timer = static_cast<unsigned short>(SHORT_SCATTER_DURATION / pow(2, level));
-         }
-      }
-      else
+      if (!opened || 0 == intro_buffer.getSampleCount())
       {
-         wave_timer--;
+         std::cerr << "Failed to load " << MUSIC_STREAM_FILES[a] << ".\n";
+         continue;
       }
+
+      channel.intro.setBuffer(intro_buffer);
+      channel.intro_length = intro_buffer.getDuration();
+      channel.loaded = 1;
+
+      prime(channel);
    }
+}
 
-   for (Ghost& ghost : ghosts)
+MusicManager::~MusicManager()
+{
+   if (underruns)
    {
-      ghost.update(level, map, ghosts[0], pacman);
+      std::cerr << "Music: " << underruns << " stream underruns.\n";
    }
 }
 
-\
-bool map_collision(bool collect_pellets, bool use_door, short x, short y, array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map)
+// parks the stream paused right where the intro ends, so the handoff is just a resume
+void MusicManager::prime(Channel& channel)
 {
-   bool output = 0;
+   channel.stream.stop();
+   channel.primed_offset = channel.intro_length < channel.stream.getDuration() ? channel.intro_length : Time::Zero;
+   channel.stream.setPlayingOffset(channel.primed_offset);
+   channel.stream.setVolume(0);
+   channel.stream.play();
+   channel.stream.pause();
+   channel.stream_gain = 0;
+   channel.stream_target = 0;
+}
 
-   float cell_x = x / static_cast<float>(CELL_SIZE);
-   float cell_y = y / static_cast<float>(CELL_SIZE);
+void MusicManager::pause()
+{
+   paused = 1;
 
-   for (unsigned char a = 0; a < 4; a++)
+   for (Channel& channel : channels)
    {
-      short cx = 0;
-      short cy = 0;
-
-      switch (a)
+      if (Sound::Playing == channel.intro.getStatus())
       {
-         case 0: cx = static_cast<short>(floor(cell_x)); cy = static_cast<short>(floor(cell_y)); break;
-         case 1: cx = static_cast<short>(ceil(cell_x)); cy = static_cast<short>(floor(cell_y)); break;
-         case 2: cx = static_cast<short>(floor(cell_x)); cy = static_cast<short>(ceil(cell_y)); break;
-         case 3: cx = static_cast<short>(ceil(cell_x)); cy = static_cast<short>(ceil(cell_y)); break;
+         channel.intro.pause();
       }
-
-      if (0 <= cx && 0 <= cy && MAP_HEIGHT > cy && MAP_WIDTH > cx)
+      if (!channel.handoff && SoundSource::Playing == channel.stream.getStatus())
       {
-         if (!collect_pellets)
-         {
-            if (Cell::Wall == map[cx][cy])
-            {
-               output = 1;
-            }
-            else if (!use_door && Cell::Door == map[cx][cy])
-            {
-               output = 1;
-            }
-         }
-         else
-         {
-            if (Cell::Energizer == map[cx][cy])
-            {
-               output = 1;
-               map[cx][cy] = Cell::Empty;
-            }
-            else if (Cell::Pellet == map[cx][cy])
-            {
-               map[cx][cy] = Cell::Empty;
-            }
-         }
+         channel.stream.pause();
       }
    }
+}
 
-   return output;
+void MusicManager::play(MusicTrack track)
+{
+   const MusicTrackSettings& settings = MUSIC_TRACK_SETTINGS[track];
+   Channel& channel = channels[settings.stream];
+
+   paused = 0;
+   current = settings.stream;
+
+   // everything else fades out while the new intro fades in
+   for (Channel& other : channels)
+   {
+      other.intro_target = 0;
+      other.stream_target = 0;
+      other.handoff = 0;
+   }
+
+   if (!channel.loaded)
+   {
+      return;
+   }
+
+   channel.intro.stop();
+   channel.intro.play();
+   channel.intro_target = 1;
+   channel.stream.setLoop(settings.loop);
+   channel.handoff = settings.loop || channel.primed_offset > Time::Zero;
 }
 
-array<array<Cell, MAP_HEIGHT>, MAP_WIDTH> convert_sketch(const array<string, MAP_HEIGHT>& map_sketch, array<Position, 4>& ghost_positions, Pacman& pacman)
+void MusicManager::resume()
 {
-   array<array<Cell, MAP_HEIGHT>, MAP_WIDTH> output_map{};
+   paused = 0;
 
-   for (unsigned char a = 0; a < MAP_HEIGHT; a++)
+   for (Channel& channel : channels)
    {
-      for (unsigned char b = 0; b < MAP_WIDTH; b++)
+      if (Sound::Paused == channel.intro.getStatus())
       {
-         output_map[b][a] = Cell::Empty;
-
-         switch (map_sketch[a][b])
-         {
-            case '#':
-               output_map[b][a] = Cell::Wall;
-               break;
-            case '=':
-               output_map[b][a] = Cell::Door;
-               break;
-            case '.':
-               output_map[b][a] = Cell::Pellet;
-               break;
-            case '0':
-               ghost_positions[0] = {static_cast<short>(CELL_SIZE * b), static_cast<short>(CELL_SIZE * a)};
-               break;
-            case '1':
-               ghost_positions[1] = {static_cast<short>(CELL_SIZE * b), static_cast<short>(CELL_SIZE * a)};
-               break;
-            case '2':
-               ghost_positions[2] = {static_cast<short>(CELL_SIZE * b), static_cast<short>(CELL_SIZE * a)};
-               break;
-            case '3':
-               ghost_positions[3] = {static_cast<short>(CELL_SIZE * b), static_cast<short>(CELL_SIZE * a)};
-               break;
-            case 'P':
-               pacman.set_position(static_cast<short>(CELL_SIZE * b), static_cast<short>(CELL_SIZE * a));
-               break;
-            case 'o':
-               output_map[b][a] = Cell::Energizer;
-               break;
-            default:
-               break;
-         }
+         channel.intro.play();
+      }
+      if (!channel.handoff && SoundSource::Paused == channel.stream.getStatus() && 0 < channel.stream_target)
+      {
+         channel.stream.play();
       }
    }
 
-   return output_map;
+   frame_clock.restart();
 }
 
-void draw_map(const array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map, RenderWindow& window)
+void MusicManager::stop()
 {
-Sprite sprite;
-Texture texture;
-   texture.loadFromFile("Resources/Images/Map" + to_string(CELL_SIZE) + ".png");
+   current = -1;
+
+   for (Channel& channel : channels)
+   {
+      channel.intro_target = 0;
+      channel.stream_target = 0;
+      channel.handoff = 0;
+   }
+}
 
-   sprite.setTexture(texture);
+// called once per frame by whichever screen is active
+void MusicManager::update()
+{
+   float step = frame_clock.restart().asSeconds() / MUSIC_FADE_SECONDS;
 
-   for (unsigned char a = 0; a < MAP_WIDTH; a++)
+   if (paused)
    {
-      for (unsigned char b = 0; b < MAP_HEIGHT; b++)
+      return;
+   }
+
+   for (unsigned char a = 0; a < MUSIC_STREAM_COUNT; a++)
+   {
+      Channel& channel = channels[a];
+
+      if (!channel.loaded)
       {
-         sprite.setPosition(static_cast<float>(CELL_SIZE * a), static_cast<float>(CELL_SIZE * b));
+         continue;
+      }
 
-         switch (map[a][b])
-         {
-            case Cell::Door:
-               sprite.setTextureRect(IntRect(2 * CELL_SIZE, CELL_SIZE, CELL_SIZE, CELL_SIZE));
-               window.draw(sprite);
-               break;
-            case Cell::Energizer:
-               sprite.setTextureRect(IntRect(CELL_SIZE, CELL_SIZE, CELL_SIZE, CELL_SIZE));
-               window.draw(sprite);
-               break;
-            case Cell::Pellet:
-               sprite.setTextureRect(IntRect(0, CELL_SIZE, CELL_SIZE, CELL_SIZE));
-               window.draw(sprite);
-               break;
-            case Cell::Wall:
-            {
-               bool down = 0;
-               bool left = 0;
-               bool right = 0;
-               bool up = 0;
+      if (channel.handoff && Sound::Stopped == channel.intro.getStatus())
+      {
+         channel.handoff = 0;
+         channel.stream_gain = channel.intro_gain;
+         channel.stream_target = 1;
+         channel.stream.setVolume(100 * channel.stream_gain);
+         channel.stream.play();
+         channel.last_offset = channel.primed_offset;
+      }
 
-               if (b < MAP_HEIGHT - 1 && Cell::Wall == map[a][1 + b]) { down = 1; }
-               if (0 < a)
-               {
-                  if (Cell::Wall == map[a - 1][b]) { left = 1; }
-               }
-               else
-               {
-                  left = 1;
-               }
+      channel.intro_gain = channel.intro_target > channel.intro_gain ? min(channel.intro_target, channel.intro_gain + step) : max(channel.intro_target, channel.intro_gain - step);
+      channel.stream_gain = channel.stream_target > channel.stream_gain ? min(channel.stream_target, channel.stream_gain + step) : max(channel.stream_target, channel.stream_gain - step);
 
-               if (a < MAP_WIDTH - 1)
-               {
-                  if (Cell::Wall == map[a + 1][b]) { right = 1; }
-               }
-               else
-               {
-                  right = 1;
-               }
+      channel.intro.setVolume(100 * channel.intro_gain);
 
-               if (0 < b && Cell::Wall == map[a][b - 1]) { up = 1; }
+      if (0 == channel.intro_gain && 0 == channel.intro_target)
+      {
+         channel.intro.stop();
+      }
 
-               sprite.setTextureRect(IntRect(CELL_SIZE * (down + 2 * (left + 2 * (right + 2 * up))), 0, CELL_SIZE, CELL_SIZE));
-               window.draw(sprite);
-               break;
+      if (SoundSource::Playing == channel.stream.getStatus())
+      {
+         channel.stream.setVolume(100 * channel.stream_gain);
+
+         // the stream fell behind the wall clock, its buffers ran dry
+         Time offset = channel.stream.getPlayingOffset();
+         if (offset >= channel.last_offset && a == current)
+         {
+            float behind = step * MUSIC_FADE_SECONDS - (offset - channel.last_offset).asSeconds();
+            if (MUSIC_UNDERRUN_SECONDS < behind)
+            {
+               underruns++;
+               std::cerr << "Music: stream underrun on " << MUSIC_STREAM_FILES[a] << ", " << static_cast<int>(1000 * behind)
+                         << " ms behind, slowest refill " << channel.stream.get_slowest_fill().asMilliseconds() << " ms.\n";
             }
-            default:
-               break;
+         }
+         channel.last_offset = offset;
+
+         if (0 == channel.stream_gain && 0 == channel.stream_target)
+         {
+            prime(channel);
          }
       }
+      else if (SoundSource::Stopped == channel.stream.getStatus() && 0 == channel.stream_target)
+      {
+         // a track that ran to its end gets parked again for the next play
+         prime(channel);
+      }
    }
 }
 
-void draw_text(bool center, unsigned short x, unsigned short y, const string& text, RenderWindow& window)
+// walls as one bit per cell and one Uint32 per row, with two empty cells of padding on every
+// side so probes just past the edge (the tunnel) read empty cells like map_collision does
+constexpr unsigned char CELL_SHIFT = 4;
+constexpr unsigned char WALL_PADDING = 2;
+constexpr unsigned char WALL_ROWS = MAP_HEIGHT + 2 * WALL_PADDING;
+
+static_assert(1 << CELL_SHIFT == CELL_SIZE, "the wall probe shifts positions into cells");
+static_assert(MAP_WIDTH + 2 * WALL_PADDING <= 32, "a bitboard row has to fit in 32 bits");
+
+class WallBitboard
 {
-   short character_x = x;
-   short character_y = y;
+   // rows[0] blocks the door as well, rows[1] is for ghosts allowed through it
+   Uint32 rows[2][WALL_ROWS];
 
-Sprite sprite;
-Texture font_texture;
-   font_texture.loadFromFile("Resources/Images/Font.png");
+   bool blocked(int x, int y, bool use_door) const;
+
+#ifdef WALL_PROBE_AVX2
+   __attribute__((target("avx2")))
+   void probe_avx2(const short* x, const short* y, const unsigned char* speed, const unsigned char* use_door, unsigned char* walls, unsigned short count) const;
+#endif
 
-   unsigned char character_width = static_cast<unsigned char>(font_texture.getSize().x / 96);
+public:
+   WallBitboard();
 
-   sprite.setTexture(font_texture);
+   void build(const array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map);
 
-   if (center)
+   // bit per direction (0:right,1:up,2:left,3:down), set when a step of speed pixels hits a wall
+   unsigned char probe(short x, short y, unsigned char speed, bool use_door) const;
+   // the same for count entities at once, eight at a time where the cpu has avx2
+   void probe_all(const short* x, const short* y, const unsigned char* speed, const unsigned char* use_door, unsigned char* walls, unsigned short count) const;
+   void probe_all_scalar(const short* x, const short* y, const unsigned char* speed, const unsigned char* use_door, unsigned char* walls, unsigned short count) const;
+};
+
+// open directions out of every tile for ghosts, padded like the wall bitboard so the tunnel
+// reads open tiles. A ghost on a tile with one way forward follows the corridor without targeting
+constexpr unsigned char JUNCTION_OFF_AXIS = 255;
+
+class JunctionTable
+{
+   unsigned char exits[2][MAP_WIDTH + 2 * WALL_PADDING][MAP_HEIGHT + 2 * WALL_PADDING];
+
+public:
+   JunctionTable();
+
+   void build(const array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map);
+
+   // open directions (0:right,1:up,2:left,3:down) for a ghost at a pixel position.
+   // Between two tiles it may go on, go back, or turn where both tiles open that way;
+   // JUNCTION_OFF_AXIS when it sits between tiles on both axes
+   unsigned char exits_at(short x, short y, bool use_door) const;
+};
+
+// BFS distances from every open tile to one target tile, shared by all ghosts heading for it,
+// searched again whenever the target steps to another tile
+constexpr unsigned short FLOW_UNREACHED = 65535;
+constexpr unsigned short FLOW_MAX_DISTANCE = MAP_WIDTH * MAP_HEIGHT;
+
+class FlowField
+{
+protected:
+   array<array<bool, MAP_HEIGHT>, MAP_WIDTH> open;
+   array<array<unsigned short, MAP_HEIGHT>, MAP_WIDTH> distance;
+   Position target;
+   unsigned long searches;
+   // tiles given a new distance, whether by a search or a repair
+   unsigned long settled_tiles;
+
+   static Position tile_at(short x, short y);
+   static bool neighbour(const Position& tile, unsigned char direction, Position& next);
+
+   bool is_target(const Position& tile) const;
+   bool reachable(const Position& tile) const;
+
+   void search();
+   // the tile just became a source or opened up, spread the shorter distances from it
+   void lower(const Position& tile);
+
+public:
+   FlowField();
+
+   unsigned long get_searches() const { return searches; }
+
+   // doors stay shut, ghosts using the door never follow the field
+   void build(const array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map);
+   void set_target(const Position& position);
+   bool targets(short x, short y) const;
+   bool same_distances(const FlowField& other) const;
+
+   // the way out of ways (bit per direction) closest to the target, 4 when none of them reaches it
+   unsigned char next_direction(short x, short y, unsigned char ways) const;
+};
+
+// a position between the last two ticks, alpha 0 is the previous tick and 1 the current one.
+// A step longer than half the maze went through the tunnel and is crossed the short way
+float interpolate(short previous, short current, float alpha)
+{
+   constexpr int tunnel = CELL_SIZE * (1 + MAP_WIDTH);
+   int step = current - previous;
+
+   if (tunnel / 2 < step)
    {
-      character_x = static_cast<short>(round(0.5f * (CELL_SIZE * MAP_WIDTH - character_width * text.substr(0, text.find_first_of('\n')).size())));
-      character_y = static_cast<short>(round(0.5f * (CELL_SIZE * MAP_HEIGHT - FONT_HEIGHT * (1 + count(text.begin(), text.end(), '\n')))));
+      step -= tunnel;
    }
-
-   for (string::const_iterator it = text.begin(); it != text.end(); ++it)
+   else if (-tunnel / 2 > step)
    {
-      if ('\n' == *it)
-      {
-         if (center)
-         {
-            const size_t offset = 1 + static_cast<size_t>(it - text.begin());
-            const size_t next_break = text.find_first_of('\n', offset);
-            const size_t len = (next_break == string::npos ? text.size() : next_break) - offset;
-            character_x = static_cast<short>(round(0.5f * (CELL_SIZE * MAP_WIDTH - character_width * text.substr(offset, len).size())));
-         }
-         else
-         {
-            character_x = x;
-         }
+      step += tunnel;
+   }
 
-         character_y += FONT_HEIGHT;
-         continue;
-      }
+   return previous + alpha * step;
+}
 
-      sprite.setPosition(character_x, character_y);
-      sprite.setTextureRect(IntRect(character_width * (*it - 32), 0, character_width, FONT_HEIGHT));
+// "1.25" as 8.8 fixed point, read digit by digit so every build gets the same speeds
+bool parse_fixed(const string& text, long& value)
+{
+   size_t point = text.find('.');
+   string whole = text.substr(0, point);
+   string fraction = string::npos == point ? "" : text.substr(point + 1);
 
-      character_x += character_width;
+   if ((whole.empty() && fraction.empty()) || 5 < whole.size() ||
+       string::npos != whole.find_first_not_of("0123456789") || string::npos != fraction.find_first_not_of("0123456789"))
+   {
+      return 0;
+   }
 
-      window.draw(sprite);
+   long numerator = 0;
+   long denominator = 1;
+   for (unsigned char a = 0; a < fraction.size() && a < 6; a++)
+   {
+      numerator = 10 * numerator + fraction[a] - '0';
+      denominator *= 10;
    }
+
+   value = (whole.empty() ? 0 : stol(whole)) << FIXED_SHIFT;
+   value += ((numerator << FIXED_SHIFT) + denominator / 2) / denominator;
+   return 1;
 }
 
-// drwa lives for chnaces 
-void draw_lives_hearts(unsigned char lives, RenderWindow& window)
+bool parse_whole(const string& text, long& value)
 {
-  
-   static Texture heartsTexture;
-   static bool textureLoaded = false;
-   static bool textureAttempted = false;
-   static unsigned short heartWidth = 0;  
-   static unsigned short heartHeight = 0; 
-   static unsigned short totalWidth = 0;   
-   
-   if (!textureAttempted)
+   if (text.empty() || 9 < text.size() || string::npos != text.find_first_not_of("0123456789"))
    {
-     
-      textureLoaded = heartsTexture.loadFromFile("Resources/Images/Heart.png");
-      if (!textureLoaded) {
-         textureLoaded = heartsTexture.loadFromFile("Resources/Images/Heart.jpeg");
-      }
-      if (!textureLoaded) {
-         textureLoaded = heartsTexture.loadFromFile("Resources/Images/Heart.jpg");
-      }
-      if (!textureLoaded) {
-         textureLoaded = heartsTexture.loadFromFile("Resources/Images/Heart.png");
-      }
-      if (!textureLoaded) {
-         textureLoaded = heartsTexture.loadFromFile("Resources/Images/Heart.jpeg");
-      }
-      
-      if (textureLoaded) {
-         totalWidth = static_cast<unsigned short>(heartsTexture.getSize().x);
-         heartHeight = static_cast<unsigned short>(heartsTexture.getSize().y);
-         // Assuming 3 hearts are arranged horizontally, divide by 3
-         heartWidth = totalWidth / 3;
-      }
-      
-      textureAttempted = true;
+      return 0;
    }
-   
-   
-   unsigned short start_x = CELL_SIZE * MAP_WIDTH - 8;  
-   unsigned short start_y = 4; 
-   
-   if (textureLoaded && heartWidth > 0)
-   {
-      
-      Sprite heartsSprite;
-      heartsSprite.setTexture(heartsTexture);
-      
-     
-     // draw and calcualte the lives and draw hearts accordingly to lives 
-      if (lives > 0 && lives <= 3)
-      {
-         // Set texture rectangle to show only the hearts we have
-         unsigned short visibleWidth = heartWidth * lives;
-         heartsSprite.setTextureRect(IntRect(0, 0, visibleWidth, heartHeight));
-         heartsSprite.setPosition(start_x - visibleWidth, start_y);
-         window.draw(heartsSprite);
-      }
-   }
-   else
+
+   value = stol(text);
+   return 1;
+}
+
+// whole pixels from a position to the next tile edge going that way, a full cell when on one
+unsigned char pixels_to_edge(short x, short y, unsigned char direction)
+{
+   unsigned char offset = (1 == direction % 2 ? y : x) & (CELL_SIZE - 1);
+
+   if (0 == direction || 3 == direction)
    {
-     
-      const unsigned short HEART_SIZE = CELL_SIZE;
-      const unsigned short SPACING = HEART_SIZE + 8;
-      
-      static Texture fallbackTexture;
-      static bool fallbackCreated = false;
-      
-      if (!fallbackCreated)
-      {
-         Image heartImage;
-         heartImage.create(CELL_SIZE, CELL_SIZE, Color(255, 0, 0));
-         fallbackTexture.create(CELL_SIZE, CELL_SIZE);
-         fallbackTexture.update(heartImage);
-         fallbackCreated = true;
-      }
-      
-      for (unsigned char i = 0; i < lives; i++)
-      {
-         Sprite heartSprite;
-         heartSprite.setTexture(fallbackTexture);
-         heartSprite.setPosition(start_x - (i * SPACING), start_y);
-         window.draw(heartSprite);
-      }
+      return CELL_SIZE - offset;
    }
+
+   return 0 == offset ? CELL_SIZE : offset;
 }
-// for scores records used linked lists bcz it always insert the score in sorting order 
-struct ScoreNode {
-    std::string name;
-    int score;
-    ScoreNode* next;
-    ScoreNode(const std::string& n, int s) : name(n), score(s), next(nullptr) {}
-};
 
-class ScoreList {
-    ScoreNode* head;
-public:
-    ScoreList() : head(nullptr) {}
-    ~ScoreList() { clear(); }
-    
-    // always add the score in sorting order
-    void add(const std::string& name, int scr) {
-   
-        ScoreNode* node = new ScoreNode(name, scr);
-        
-    
-        if (!head || scr > head->score) {
-            node->next = head; 
-            head = node;
-        } else {
-            
-            ScoreNode* cur = head;
-            while (cur->next && cur->next->score >= scr) {
-                cur = cur->next;  
-            }
-            
-            node->next = cur->next; 
-            cur->next = node;
-        }
-        
-       // always show the top 5 highest scores in sorted order of linked list
-        ScoreNode* cur = head; 
-        int count = 1;
-        while (cur && cur->next) {
-            if (count == 5) {
-                
-                ScoreNode* del = cur->next; 
-                cur->next = nullptr;
-                while(del) { 
-                    ScoreNode* nxt = del->next; 
-                    delete del;  // easy to dlt the score
-                    del = nxt; 
-                }
-                break;
-            }
-            cur = cur->next; 
-            ++count;
-        }
-    }
-    
-    // displaying the score in view score
-    string getListInfo() {
-        std::string info = "Linked List: ";
-        ScoreNode* cur = head;
-        int count = 0;
-        while (cur && count < 5) {
-            info += cur->name + "(" + std::to_string(cur->score) + ")";
-            if (cur->next) info += " -> ";
-            cur = cur->next;
-            count++;
-        }
-        if (!head) info += "Empty";
-        return info;
-    }
-    
-   //  counting the total no of records
-    int getNodeCount() {
-        int count = 0;
-        ScoreNode* cur = head;
-        while (cur) {
-            count++;
-            cur = cur->next;
-        }
-        return count;
-    }
-    
-    ScoreNode* getHead() { return head; }  
-    
-   
-    void clear() {
-        while(head) { 
-            ScoreNode* nxt = head->next; 
-            delete head;  
-            head = nxt;  
-        }
-    }
+// the whole pixels an entity covers this tick out of the distance it has built up (speed added
+// every tick, in 1/256 pixels). A step ends on the next tile edge and the rest waits for the next
+// tick, so entities stop on every tile edge for the walls and junctions at any speed
+unsigned char fixed_step(unsigned short& progress, short x, short y, unsigned char direction)
+{
+   unsigned char pixels = static_cast<unsigned char>(min<unsigned short>(progress >> FIXED_SHIFT, pixels_to_edge(x, y, direction)));
+   progress -= pixels << FIXED_SHIFT;
+   return pixels;
+}
+
+// everything that changes from one level to the next, read once when the table loads so a tick
+// only looks numbers up. Speeds are 8.8 fixed point pixels per tick, durations are in ticks
+struct LevelSettings
+{
+   unsigned short escape_speed;
+   unsigned short frightened_speed;
+   unsigned short ghost_speed;
+   unsigned short pacman_speed;
+   unsigned short chase_duration;
+   unsigned short energizer_duration;
+   unsigned short flash_start;
+   unsigned short long_scatter_duration;
+   unsigned short short_scatter_duration;
+   int energizer_score;
+   int level_bonus;
+   int pellet_score;
 };
 
-// lobby creation
-void draw_lobby_text(unsigned short x, unsigned short y, const string& text, RenderWindow& window, bool highlight = false, bool center = false)
+// the built-in curve runs out once the halved durations reach a single tick
+constexpr unsigned char DEFAULT_LEVEL_COUNT = 10;
+
+const string LEVELS_FILE = "Resources/levels.cfg";
+
+// difficulty per level, tunable without a rebuild. In the file "level n" starts the record for
+// level n as a copy of the one before it and "name value" lines change it, levels past the
+// last record play like the last one
+class LevelTable
 {
-   short character_x = x;
-   short character_y = y;
+   vector<LevelSettings> levels;
 
-Sprite sprite;
-Texture font_texture;
-   font_texture.loadFromFile("Resources/Images/Font.png");
+   static bool set(LevelSettings& settings, const string& name, const string& text);
 
-   unsigned char character_width = static_cast<unsigned char>(font_texture.getSize().x / 96);
+public:
+   LevelTable();
 
-   sprite.setTexture(font_texture);
-   
+   // the original curve: scatter and energizer times halve every level, but never reach 0
+   static LevelSettings defaults(unsigned char level);
 
-   float scale = highlight ? 2.5f : 2.0f;
-   sprite.setScale(scale, scale);
+   const LevelSettings& get(unsigned char level) const { return levels[min<size_t>(level, levels.size() - 1)]; }
+   size_t size() const { return levels.size(); }
 
-   // Calculate text width for centering
-   float text_width = 0;
-   for (string::const_iterator it = text.begin(); it != text.end(); ++it)
-   {
-      if (*it == '\n') break;
-      text_width += character_width * scale;
-   }
+   // read from the asset bundle, or from disk when it is not packed. A missing file or one with a
+   // mistake in it leaves the table as it was
+   bool load(const string& file);
+};
 
-   
-   if (center)
+LevelTable::LevelTable()
+{
+   for (unsigned char a = 0; a < DEFAULT_LEVEL_COUNT; a++)
    {
-      unsigned short window_width = window.getSize().x;
-      character_x = static_cast<short>((window_width - text_width) / 2);
+      levels.push_back(defaults(a));
    }
+}
 
-   short start_x = character_x;
+LevelSettings LevelTable::defaults(unsigned char level)
+{
+   LevelSettings settings;
+   settings.escape_speed = GHOST_ESCAPE_SPEED;
+   settings.frightened_speed = GHOST_FRIGHTENED_SPEED;
+   settings.ghost_speed = GHOST_SPEED;
+   settings.pacman_speed = PACMAN_SPEED;
+   settings.chase_duration = CHASE_DURATION;
+   settings.energizer_duration = static_cast<unsigned short>(max(1, ENERGIZER_DURATION >> min<unsigned char>(level, 15)));
+   settings.flash_start = GHOST_FLASH_START;
+   settings.long_scatter_duration = static_cast<unsigned short>(max(1, LONG_SCATTER_DURATION >> min<unsigned char>(level, 15)));
+   settings.short_scatter_duration = static_cast<unsigned short>(max(1, SHORT_SCATTER_DURATION >> min<unsigned char>(level, 15)));
+   settings.energizer_score = 50;
+   settings.level_bonus = 5000;
+   settings.pellet_score = 10;
+   return settings;
+}
 
-   for (string::const_iterator it = text.begin(); it != text.end(); ++it)
+bool LevelTable::set(LevelSettings& settings, const string& name, const string& text)
+{
+   long value;
+
+   // speeds may have a fraction, but no entity covers a whole cell in one tick
+   if (6 < name.size() && "_speed" == name.substr(name.size() - 6))
    {
-      if ('\n' == *it)
+      if (!parse_fixed(text, value) || 0 >= value || value >= CELL_SIZE * FIXED_ONE)
       {
-        
-         if (center)
-         {
-            
-            size_t offset = 1 + static_cast<size_t>(it - text.begin());
-            size_t next_break = text.find_first_of('\n', offset);
-            size_t len = (next_break == string::npos ? text.size() : next_break) - offset;
-            string next_line = text.substr(offset, len);
-            float next_line_width = next_line.size() * character_width * scale;
-            character_x = static_cast<short>((window.getSize().x - next_line_width) / 2);
-         }
-         else
-         {
-            character_x = start_x;
-         }
-         character_y += FONT_HEIGHT * scale;
-         continue;
+         return 0;
       }
 
-      sprite.setPosition(character_x, character_y);
-      sprite.setTextureRect(IntRect(character_width * (*it - 32), 0, character_width, FONT_HEIGHT));
-
-      character_x += character_width * scale;
+      if ("escape_speed" == name) settings.escape_speed = static_cast<unsigned short>(value);
+      else if ("frightened_speed" == name) settings.frightened_speed = static_cast<unsigned short>(value);
+      else if ("ghost_speed" == name) settings.ghost_speed = static_cast<unsigned short>(value);
+      else if ("pacman_speed" == name) settings.pacman_speed = static_cast<unsigned short>(value);
+      else return 0;
 
-      window.draw(sprite);
+      return 1;
    }
-}
 
+   if (!parse_whole(text, value))
+   {
+      return 0;
+   }
 
-int showLobby(ScoreNode* head) {
-   
-RenderWindow lobbyWindow(VideoMode(800, 700), "Pac-Man Lobby", Style::Titlebar | Style::Close);
-
-    // adding the music
-    Music lobbyMusic;
-    if (!lobbyMusic.openFromFile("Resources/Music/pacman_theme.wav")) {
-        // Try alternative format
-        if (!lobbyMusic.openFromFile("Resources/Music/pacman_theme.wav")) {
-            std::cerr << "Failed to load lobby theme music.\n";
-        }
-    }
-    if (lobbyMusic.openFromFile("Resources/Music/pacman_theme.wav") || 
-        lobbyMusic.openFromFile("Resources/Music/pacman_theme.wav")) {
-        lobbyMusic.setLoop(true);
-        lobbyMusic.play();
-    }
+   bool ticks = 0 < value && value <= USHRT_MAX;
+   bool points = value <= 1000000;
 
-    // background image 
-    const string lobbyBackgroundImage = "Resources/Images/Lobby.jpg";
+   if ("chase_duration" == name && ticks) settings.chase_duration = static_cast<unsigned short>(value);
+   else if ("energizer_duration" == name && ticks) settings.energizer_duration = static_cast<unsigned short>(value);
+   else if ("flash_start" == name && value <= USHRT_MAX) settings.flash_start = static_cast<unsigned short>(value);
+   else if ("long_scatter_duration" == name && ticks) settings.long_scatter_duration = static_cast<unsigned short>(value);
+   else if ("short_scatter_duration" == name && ticks) settings.short_scatter_duration = static_cast<unsigned short>(value);
+   else if ("energizer_score" == name && points) settings.energizer_score = static_cast<int>(value);
+   else if ("level_bonus" == name && points) settings.level_bonus = static_cast<int>(value);
+   else if ("pellet_score" == name && points) settings.pellet_score = static_cast<int>(value);
+   else return 0;
 
-    // Load background image
-Texture bgTexture;
-Sprite bgSprite;
-    bool imageLoaded = bgTexture.loadFromFile(lobbyBackgroundImage);
+   return 1;
+}
 
-    if (imageLoaded) {
-        bgSprite.setTexture(bgTexture);
+bool LevelTable::load(const string& file)
+{
+   const void* data;
+   size_t size;
+   istringstream packed;
+   ifstream unpacked;
+   istream* input = &packed;
 
-        float windowWidth  = lobbyWindow.getSize().x;
-        float windowHeight = lobbyWindow.getSize().y;
+   if (asset_bundle.find(file, data, size))
+   {
+      packed.str(string(static_cast<const char*>(data), size));
+   }
+   else
+   {
+      unpacked.open(file);
+      input = &unpacked;
 
-        float textureWidth  = bgTexture.getSize().x;
-        float textureHeight = bgTexture.getSize().y;
+      if (!unpacked.is_open())
+      {
+         std::cerr << "Levels: " << file << " is neither in the asset bundle nor on disk, keeping the current levels.\n";
+         return 0;
+      }
+   }
 
-        float scaleX = windowWidth / textureWidth;
-        float scaleY = windowHeight / textureHeight;
+   vector<LevelSettings> loaded;
+   string line;
+   unsigned short line_number = 0;
 
-        bgSprite.setScale(scaleX, scaleY);
-    }
+   while (getline(*input, line))
+   {
+      line_number++;
 
-   
-Color bgColor(25, 25, 112);  // dark blue
+      istringstream words(line.substr(0, line.find('#')));
+      string name;
+      string text;
+      string rest;
+      long value;
 
-    
-    unsigned short startButtonWidth = 300;  
-    unsigned short startButtonHeight = 60;  
-    unsigned short startButtonY = 0;  
-    unsigned short startButtonX = 0;  
+      if (!(words >> name))
+      {
+         continue;
+      }
 
-    unsigned short viewScoreButtonY = 0;  
-    unsigned short viewScoreButtonX = 0;  
+      string error;
 
-    bool startClicked = false;
-    bool viewScoreClicked = false;
-    bool startButtonHovered = false;
-    bool viewScoreButtonHovered = false;
+      if (!(words >> text) || words >> rest)
+      {
+         error = "expected a name and a number";
+      }
+      else if ("level" == name)
+      {
+         if (!parse_whole(text, value) || value <= static_cast<long>(loaded.size()) || value > 256)
+         {
+            error = "levels have to go up from 1 to 256";
+         }
 
-    while (lobbyWindow.isOpen()) {
-Event event;
-        while (lobbyWindow.pollEvent(event)) {
-            if (event.type == Event::Closed) {
-                lobbyMusic.stop();  // Stop music when closing
-                lobbyWindow.close();
-                return 0;
-            }
+         while (error.empty() && static_cast<long>(loaded.size()) < value)
+         {
+            loaded.push_back(loaded.empty() ? defaults(0) : loaded.back());
+         }
+      }
+      else if (loaded.empty())
+      {
+         error = name + " comes before the first level";
+      }
+      else if (!set(loaded.back(), name, text))
+      {
+         error = "unknown setting or value out of range for " + name;
+      }
 
-Vector2i mousePos = Mouse::getPosition(lobbyWindow);
+      if (!error.empty())
+      {
+         std::cerr << "Levels: " << file << " line " << line_number << ": " << error << ".\n";
+         return 0;
+      }
+   }
 
-            // Start button click
-            if (event.type == Event::MouseButtonPressed &&
-                event.mouseButton.button == Mouse::Left) {
-                
-                if (mousePos.x >= startButtonX && mousePos.x <= startButtonX + startButtonWidth &&
-                    mousePos.y >= startButtonY && mousePos.y <= startButtonY + startButtonHeight) {
-                    lobbyMusic.stop();  // Stop lobby music when starting game
-                    startClicked = true;
-                    lobbyWindow.close();
-                }
-                else if (mousePos.x >= viewScoreButtonX && mousePos.x <= viewScoreButtonX + startButtonWidth &&
-                         mousePos.y >= viewScoreButtonY && mousePos.y <= viewScoreButtonY + startButtonHeight) {
-                    viewScoreClicked = true;
-                    lobbyWindow.close();
-                }
-            }
+   if (loaded.empty())
+   {
+      std::cerr << "Levels: " << file << " has no levels.\n";
+      return 0;
+   }
 
-            // Press Enter to start, V to view scores
-            if (event.type == Event::KeyPressed) {
-                if (event.key.code == Keyboard::Enter) {
-                    lobbyMusic.stop();  // Stop lobby music when starting game
-                    startClicked = true;
-                    lobbyWindow.close();
-                }
-                else if (event.key.code == Keyboard::V) {
-                    viewScoreClicked = true;
-                    lobbyWindow.close();
-                }
-            }
+   levels = loaded;
+   return 1;
+}
 
-            // Hover detection
-            if (event.type == Event::MouseMoved) {
-                startButtonHovered = (mousePos.x >= startButtonX &&
-                                     mousePos.x <= startButtonX + startButtonWidth &&
-                                     mousePos.y >= startButtonY &&
-                                     mousePos.y <= startButtonY + startButtonHeight);
-                
-                viewScoreButtonHovered = (mousePos.x >= viewScoreButtonX &&
-                                         mousePos.x <= viewScoreButtonX + startButtonWidth &&
-                                         mousePos.y >= viewScoreButtonY &&
-                                         mousePos.y <= viewScoreButtonY + startButtonHeight);
-            }
-        }
+// FNV-1a over the simulation state, fed whole numbers only and low byte first, so two builds
+// that played the same ticks get the same hash whatever the compiler or cpu. long and enums
+// change size between platforms and have to be cast to a fixed width first
+class StateHash
+{
+   Uint64 value;
 
-        // DRAW SECTION
-        lobbyWindow.clear(bgColor);
+public:
+   StateHash() : value(14695981039346656037ULL) {}
 
-        if (imageLoaded) {
-            lobbyWindow.draw(bgSprite);
-        }
+   template<typename T>
+   void add(T field)
+   {
+      static_assert(is_integral<T>::value, "only whole numbers hash the same everywhere");
+      static_assert(!is_same<T, long>::value && !is_same<T, unsigned long>::value, "long is 4 bytes on some platforms and 8 on others");
 
-        unsigned short window_width = lobbyWindow.getSize().x;
-        unsigned short window_height = lobbyWindow.getSize().y;
+      Uint64 bits = static_cast<Uint64>(field);
+      for (unsigned char a = 0; a < sizeof(T); a++)
+      {
+         value = (value ^ (bits >> 8 * a & 255)) * 1099511628211ULL;
+      }
+   }
 
-        // Title - centered horizontally, near top
-        draw_lobby_text(0, 30, "PAC-MAN", lobbyWindow, true, true);
+   template<typename T>
+   void add(const vector<T>& fields)
+   {
+      for (const T& field : fields)
+      {
+         add(field);
+      }
+   }
 
-        // Calculate centered vertical positions for buttons
-        unsigned short center_y = window_height / 2;
-        unsigned short startButtonY_pos = center_y- 80;  // Above center
-        unsigned short viewScoreButtonY_pos = center_y + 10;  // Below center
+   Uint64 get() const { return value; }
+};
 
-        // Update button click areas to match text positions (centered horizontally)
-        startButtonX = (window_width - startButtonWidth) / 2;
-        startButtonY = startButtonY_pos;
-        viewScoreButtonX = (window_width - startButtonWidth) / 2;
-        viewScoreButtonY = viewScoreButtonY_pos;
+//pacman class for direction and position locat
+class Pacman
+{
+   bool animation_over;
+   bool dead;
+   unsigned char direction;
+   unsigned short animation_timer;
+   unsigned short energizer_timer;
+   // 1/256 pixels built up towards the next whole pixel step
+   unsigned short progress;
+   Position position;
+   // where the current tick started, drawing blends from here to position
+   Position previous_position;
 
-        // Start Button - centered both horizontally and vertically
-        if (startButtonHovered)
-            draw_lobby_text(0, startButtonY_pos, "START GAME", lobbyWindow, true, true);
-        else
-            draw_lobby_text(0, startButtonY_pos, "START GAME", lobbyWindow, false, true);
+public:
+   Pacman();
 
-        // View Score Button - centered both horizontally and vertically
-        if (viewScoreButtonHovered)
-            draw_lobby_text(0, viewScoreButtonY_pos, "VIEW SCORE", lobbyWindow, true, true);
-        else
-            draw_lobby_text(0, viewScoreButtonY_pos, "VIEW SCORE", lobbyWindow, false, true);
+   bool get_animation_over() const;
+   bool get_dead() const;
+   unsigned char get_direction() const;
+   unsigned short get_energizer_timer() const;
 
-        // Instructions - centered horizontally, near bottom
-        draw_lobby_text(0, window_height - 80, "Press START/Enter or VIEW SCORE/V", lobbyWindow, false, true);
+   // animations advance once per tick, frames in between only move the sprites
+   void animate(bool victory);
+   void begin_tick();
+   void draw(bool victory, float alpha, SpriteBatch& batch) const;
+   void hash(StateHash& state) const;
+   void reset();
+   void set_animation_timer(unsigned short value);
+   void set_dead(bool value);
+   void set_energizer_timer(unsigned short value);
+   void set_position(short x, short y);
+   // turn is the buffered direction (4 for none), held has a bit per direction key still down
+   void update(const LevelSettings& settings, array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map, const WallBitboard& wall_bits, unsigned char turn, unsigned char held, int& score, AudioEventQueue& audio_events);
 
-        lobbyWindow.display();
-    }
+   Position get_position() const;
+};
 
-    lobbyMusic.stop();  // Stop music before returning
-    if (viewScoreClicked) return 2;
-    if (startClicked) return 1;
-    return 0;
-}
+//ghost class used for here with position and target and direction providing using bfs
+// ghost personalities as data. In chase mode the target is pacman moved lead cells ahead,
+// flankers then double the vector from ghost 0 to it, shy ghosts go to their corner inside shy cells
+struct GhostBehaviour
+{
+   Position scatter;
+   unsigned char lead;
+   bool flank;
+   unsigned char shy;
+};
 
+constexpr unsigned char GHOST_BEHAVIOUR_COUNT = 4;
+const GhostBehaviour GHOST_BEHAVIOURS[GHOST_BEHAVIOUR_COUNT] = {
+   {{CELL_SIZE * (MAP_WIDTH - 1), 0}, 0, 0, 0},
+   {{0, 0}, GHOST_1_CHASE, 0, 0},
+   {{CELL_SIZE * (MAP_WIDTH - 1), CELL_SIZE * (MAP_HEIGHT - 1)}, GHOST_2_CHASE, 1, 0},
+   {{0, CELL_SIZE * (MAP_HEIGHT - 1)}, 0, 0, GHOST_3_CHASE}
+};
 
-void showScoresScreen(Font& font, const std::string& bgImagePath, ScoreNode* head) {
-RenderWindow win(VideoMode(340, 280), "Top Scores - Linked List");
-Texture bgTexture; bgTexture.loadFromFile(bgImagePath); Sprite bgSprite(bgTexture);
-Text title("TOP 5 SCORES", font, 26); title.setFillColor(Color::Yellow); title.setPosition(60, 10);
-    
-  // displaying the linked list in gui interfrence
-    string listInfo = "Linked List Traversal:";
-Text infoText(listInfo, font, 14); 
-    infoText.setFillColor(Color::Cyan);
-    infoText.setPosition(20, 40);
-    
-    vector<Text> lines;
-    
-   
-    ScoreNode* cur = head;  
-    int node_count = 0;
-    for (int i=0; i<5; ++i) {
-        string row = to_string(i+1) + ". ";
-        if (cur) { 
-            // LINKED LIST: Access current node data
-            row += cur->name + " - " + to_string(cur->score);
-            if (cur->next) {
-                row += " -> next";
-            } else {
-                row += " -> null";
-            }
-            cur = cur->next;  
-            node_count++;
-        }
-        else row += "[empty]";
-        lines.emplace_back(row, font, 18);
-        lines.back().setPosition(30, 65 + i*35);
-    }
-    
-    // Show node count
-    string countText = "Nodes: " + std::to_string(node_count);
-Text countDisplay(countText, font, 16);
-    countDisplay.setFillColor(Color::Green);
-    countDisplay.setPosition(20, 250);
-    while (win.isOpen()) {
-Event e;
-        while (win.pollEvent(e)) {
-            if (e.type == Event::Closed || (e.type == Event::KeyPressed)) win.close();
-        }
-        win.clear(); 
-        win.draw(bgSprite); 
-        win.draw(title);
-        win.draw(infoText);
-        win.draw(countDisplay);
-        for (auto& l : lines) win.draw(l);
-        win.display();
-    }
+// every ghost's state in parallel arrays, updated one pass at a time over all of them:
+// modes, targets, wall probes, directions, moves and the pacman check. Ghost 0 aims and moves
+// before the others, flankers aim from it
+class GhostManager
+{
+   unsigned char current_wave;
+   unsigned short wave_timer;
+   unsigned short count;
+
+   Position home;
+   Position home_exit;
+   // the level being played, set on reset
+   LevelSettings settings;
+
+   vector<short> x;
+   vector<short> y;
+   vector<short> target_x;
+   vector<short> target_y;
+   vector<unsigned char> behaviour;
+   vector<unsigned char> direction;
+   vector<unsigned char> movement_mode;
+   vector<unsigned char> use_door;
+   vector<unsigned char> frightened_mode;
+   // 8.8 pixels per tick for the mode each ghost is in, and the 1/256 pixels built up with it
+   vector<unsigned short> speed;
+   vector<unsigned short> progress;
+   // whole pixels the walls are probed at, how far the ghost gets this tick going straight on
+   vector<unsigned char> step;
+   vector<unsigned char> moving;
+   // a bit per direction (0:right,1:up,2:left,3:down), set by the wall probe pass
+   vector<unsigned char> walls;
+   vector<unsigned short> animation_timer;
+   // where the current tick started, drawing blends from here to x and y
+   vector<short> previous_x;
+   vector<short> previous_y;
+
+   // chase and scatter targets worked out, to compare against evaluating every ghost every tick
+   unsigned long target_updates;
+   // frightened ghosts turn with these instead of rand(), so a seed replays the same everywhere
+   Uint32 random_state;
+
+   int target_distance(unsigned short ghost, unsigned char direction_override) const;
+   unsigned char open_ways(unsigned short ghost) const;
+   unsigned char roll_direction();
+
+   // each pass covers the ghosts from first up to last
+   void advance_waves(const Pacman& pacman);
+   void update_modes(Pacman& pacman, unsigned short first, unsigned short last);
+   void update_doors(unsigned short first, unsigned short last);
+   void find_exits(const WallBitboard& wall_bits, const JunctionTable* junctions, unsigned short first, unsigned short last);
+   void update_targets(Pacman& pacman, bool every_ghost, unsigned short first, unsigned short last);
+   void choose_directions(const FlowField* chase_field, unsigned short first, unsigned short last);
+   void move(unsigned short first, unsigned short last);
+   void check_pacman(Pacman& pacman, unsigned short first, unsigned short last);
+
+public:
+   explicit GhostManager(unsigned short in_count = GHOST_BEHAVIOUR_COUNT);
+
+   unsigned short get_count() const { return count; }
+   unsigned long get_target_updates() const { return target_updates; }
+
+   // everything that decides where the ghosts go next, targets aside
+   bool same_state(const GhostManager& other) const;
+   bool same_targets(const GhostManager& other) const { return target_x == other.target_x && target_y == other.target_y; }
+
+   void animate();
+   void begin_tick();
+   void draw(bool flash, float alpha, SpriteBatch& batch) const;
+   void hash(StateHash& state) const;
+   void reset(const LevelSettings& level_settings, const array<Position, 4>& ghost_positions);
+   void seed(Uint32 value);
+   // without junctions every ghost probes its walls and works out its target every tick,
+   // ghosts whose target sits on the chase field's tile follow the field at junctions
+   void update(const WallBitboard& wall_bits, const JunctionTable* junctions, const FlowField* chase_field, Pacman& pacman);
+   // every pass for one ghost before the next ghost, the order the per-ghost objects updated in.
+   // update has to end up the same, --verify-junctions holds it against this
+   void update_one_by_one(const WallBitboard& wall_bits, const JunctionTable* junctions, const FlowField* chase_field, Pacman& pacman);
+};
+
+array<array<Cell, MAP_HEIGHT>, MAP_WIDTH> convert_sketch(const array<string, MAP_HEIGHT>& map_sketch, array<Position, 4>& ghost_positions, Pacman& pacman);
+// walls and the door when static_cells is 1, pellets and energizers when it is 0
+void draw_map(const array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map, RenderTarget& window, bool static_cells);
+void draw_text(bool center, unsigned short x, unsigned short y, const string& text, RenderTarget& window);
+
+
+// Pacman implementation there 
+Pacman::Pacman() :
+   animation_over(0),
+   dead(0),
+   direction(0),
+   animation_timer(0),
+   energizer_timer(0),
+   progress(0),
+   position({0, 0}),
+   previous_position({0, 0})
+{
 }
 
-std::string askName(Font& font, const std::string& bgImagePath) {
-RenderWindow window(VideoMode(350, 100), "Enter Name");
-Texture bgTexture; bgTexture.loadFromFile(bgImagePath); Sprite bgSprite(bgTexture);
-Text prompt("Enter your name:", font, 20); prompt.setPosition(8, 10);
-    std::string nameStr; Text nameDisplay("", font, 22); nameDisplay.setPosition(8, 44);
-    while (window.isOpen()) {
-Event event;
-        while (window.pollEvent(event)) {
-            if (event.type == Event::Closed) window.close();
-            if (event.type == Event::TextEntered) {
-                if (event.text.unicode == '\b') { if (!nameStr.empty()) nameStr.pop_back();
-                } else if (event.text.unicode == '\r' || event.text.unicode == '\n') {
-                    if (!nameStr.empty()) { window.close(); return nameStr; }
-                } else if (event.text.unicode < 128 && nameStr.size() < 12 && event.text.unicode >= 32)
-                    nameStr += static_cast<char>(event.text.unicode);
-            }
-            if (event.type == Event::KeyPressed && event.key.code == Keyboard::Enter)
-                if (!nameStr.empty()) { window.close(); return nameStr; }
-        }
-        nameDisplay.setString(nameStr + '_');
-        window.clear(); window.draw(bgSprite); window.draw(prompt); window.draw(nameDisplay); window.display();
-    }
-    return "Player";
+bool Pacman::get_animation_over() const
+{
+   return animation_over;
 }
 
-void playGame(const std::string& playerName, Font& font, const std::string& bgImagePath) {
-RenderWindow win(VideoMode(360, 120), "Playing Game!");
-Texture bgTexture; bgTexture.loadFromFile(bgImagePath); Sprite bgSprite(bgTexture);
-Text info("Playing as: " + playerName, font, 20); info.setPosition(18, 38);
-    int frame = 0;
-    while (win.isOpen() && frame < 70) {
-Event e; while (win.pollEvent(e)) if (e.type == Event::Closed) win.close();
-        win.clear(); win.draw(bgSprite); win.draw(info); win.display(); ++frame;
-    }
+bool Pacman::get_dead() const
+{
+   return dead;
 }
 
-// getiing the name of player here
-string ask_player_name(RenderWindow& window) {
-Font font;
-    font.loadFromFile("Resources/Images/Font.ttf"); 
-Text prompt("Enter your name (max 10 chars):", font, 22);
-    prompt.setFillColor(Color::White);
-    prompt.setPosition(20, 40);
-Text input_text("", font, 22);
-    input_text.setFillColor(Color::Yellow);
-    input_text.setPosition(20, 80);
-    
-    std::string name;
-    bool done = false;
-    while (!done && window.isOpen()) {
-Event event;
-        while (window.pollEvent(event)) {
-            if (event.type == Event::Closed) window.close();
-            if (event.type == Event::TextEntered) {
-                if (event.text.unicode == 8) { // backspace
-                    if (!name.empty()) name.pop_back();
-                } else if (event.text.unicode == 13) { // enter
-                    done = !name.empty();
-                } else if (event.text.unicode < 128 && isalnum(event.text.unicode) && name.size() < 10) {
-                    name += static_cast<char>(event.text.unicode);
-                }
-            }
-        }
-        window.clear(Color::Black);
-        window.draw(prompt);
-        input_text.setString(name + '_');
-        window.draw(input_text);
-        window.display();
-    }
-    return name.empty() ? "Player" : name;
+unsigned char Pacman::get_direction() const
+{
+   return direction;
 }
 
-// Saving score to file named the  scores.txxt
-void save_score(const string& name, int score) {
-    ofstream ofs("scores.txt", ios::app);
-    if (ofs.is_open()) {
-        ofs << name << ' ' << score << '\n';
-        ofs.close();
-    }
+unsigned short Pacman::get_energizer_timer() const
+{
+   return energizer_timer;
 }
 
-// get the scores for scores.txt
-void load_scores_from_file(ScoreList& score_list) {
-    ifstream ifs("scores.txt");
-    if (ifs.is_open()) {
-        string name;
-        int score;
-        while (ifs >> name >> score) {
-            score_list.add(name, score);
-        }
-        ifs.close();
-    }
+void Pacman::animate(bool victory)
+{
+   if (dead || victory)
+   {
+      if (animation_timer < PACMAN_DEATH_FRAMES * PACMAN_ANIMATION_SPEED)
+      {
+         animation_timer++;
+      }
+      else
+      {
+         animation_over = 1;
+      }
+   }
+   else
+   {
+      animation_timer = (1 + animation_timer) % (PACMAN_ANIMATION_FRAMES * PACMAN_ANIMATION_SPEED);
+   }
 }
 
-// Read top 5 scores from file
-vector<pair<string, int>> get_top_scores() { // just read the top 5 highest scores
-    vector<pair<string, int>> scores;
-    ifstream ifs("scores.txt");
-    string name;
-    int score;
-    while (ifs >> name >> score) {
-        scores.emplace_back(name, score);
-    }
-    std::sort(scores.begin(), scores.end(), [](auto &a, auto &b) { return a.second > b.second; });
-    if (scores.size() > 5) scores.resize(5);
-    return scores;
+void Pacman::begin_tick()
+{
+   previous_position = position;
 }
 
+void Pacman::draw(bool victory, float alpha, SpriteBatch& batch) const
+{
+   float draw_x = interpolate(previous_position.x, position.x, alpha);
+   float draw_y = interpolate(previous_position.y, position.y, alpha);
 
-void showViewScoreScreen(ScoreNode* head) {
-RenderWindow viewWindow(VideoMode(600, 500), "Top 5 Scores", Style::Titlebar | Style::Close);
-    
-  
-    const std::string viewScoreBackgroundImage = "Resources/Images/ViewScore.png";
-    
+   if (dead || victory)
+   {
+      // the timer already moved on to the next frame, the one shown is the frame it moved from
+      if (0 < animation_timer && animation_timer <= PACMAN_DEATH_FRAMES * PACMAN_ANIMATION_SPEED && !animation_over)
+      {
+         unsigned char frame = static_cast<unsigned char>(floor((animation_timer - 1) / static_cast<float>(PACMAN_ANIMATION_SPEED)));
 
-Texture bgTexture;
-Sprite bgSprite;
-    bool imageLoaded = bgTexture.loadFromFile(viewScoreBackgroundImage);
-    
-    if (imageLoaded) {
-        bgSprite.setTexture(bgTexture);
-        
-        float windowWidth  = viewWindow.getSize().x;
-        float windowHeight = viewWindow.getSize().y;
-        
-        float textureWidth  = bgTexture.getSize().x;
-        float textureHeight = bgTexture.getSize().y;
-        
-        float scaleX = windowWidth / textureWidth;
-        float scaleY = windowHeight / textureHeight;
-        
-        bgSprite.setScale(scaleX, scaleY);
-    }
-    
-    
-Color bgColor(25, 25, 112);
-    
-    while (viewWindow.isOpen()) {
-Event event;
-        while (viewWindow.pollEvent(event)) {
-            if (event.type == Event::Closed || 
-                (event.type == Event::KeyPressed && event.key.code == Keyboard::Escape)) {
-                viewWindow.close();
-            }
-        }
-        
-        viewWindow.clear(bgColor);
-        
-        // Draw background image if loaded
-        if (imageLoaded) {
-            viewWindow.draw(bgSprite);
-        }
-        
-        
-        draw_lobby_text(0, 50, "TOP 5 SCORES", viewWindow, true, true);
-        
-        ScoreNode* cur = head;
-        for (int i = 0; i < 5; ++i) {
-            string row = to_string(i + 1) + ". ";
-            
-            if (cur) {
-                row += cur->name + " - " + to_string(cur->score);
-                cur = cur->next;
-            } else {
-                row += "[No score yet]";
-            }
-            
-            draw_lobby_text(0, 150 + i * 50, row, viewWindow, false, true);
-        }
-        
-        draw_lobby_text(0, viewWindow.getSize().y - 50, "Press ESC to close", viewWindow, false, true);
-        
-        viewWindow.display();
-    }
+         batch.add(draw_x, draw_y, atlas_rect(ATLAS_PACMANDEATH16, CELL_SIZE * frame, 0, CELL_SIZE, CELL_SIZE));
+      }
+   }
+   else
+   {
+      unsigned char frame = static_cast<unsigned char>(floor(animation_timer / static_cast<float>(PACMAN_ANIMATION_SPEED)));
+
+      batch.add(draw_x, draw_y, atlas_rect(ATLAS_PACMAN16, CELL_SIZE * frame, CELL_SIZE * direction, CELL_SIZE, CELL_SIZE));
+   }
+}
+
+void Pacman::hash(StateHash& state) const
+{
+   state.add(animation_over);
+   state.add(dead);
+   state.add(direction);
+   state.add(animation_timer);
+   state.add(energizer_timer);
+   state.add(progress);
+   state.add(position.x);
+   state.add(position.y);
+}
+
+void Pacman::reset()
+{
+   animation_over = 0;
+   dead = 0;
+   direction = 0;
+   animation_timer = 0;
+   energizer_timer = 0;
+   progress = 0;
 }
 
-// Ask for player name using bitmap font
-std::string ask_player_name_bitmap() {
-RenderWindow nameWindow(VideoMode(500, 200), "Enter Your Name", Style::Titlebar | Style::Close);
-Color bgColor(0, 0, 0);
-    
-    std::string name = "";
-    bool done = false;
-    
-    while (nameWindow.isOpen() && !done) {
-Event event;
-        while (nameWindow.pollEvent(event)) {
-            if (event.type == Event::Closed) {
-                nameWindow.close();
-                return "Player";
-            }
-            
-            if (event.type == Event::TextEntered) {
-                if (event.text.unicode == 8) { // Backspace
-                    if (!name.empty()) name.pop_back();
-                } else if (event.text.unicode == 13 || event.text.unicode == 10) { // Enter
-                    if (!name.empty()) {
-                        done = true;
-                        nameWindow.close();
-                    }
-                } else if (event.text.unicode >= 32 && event.text.unicode < 128 && name.size() < 15) {
-                    name += static_cast<char>(event.text.unicode);
-                }
-            }
-        }
-        
-        nameWindow.clear(bgColor);
-        
-        draw_lobby_text(0, 30, "Enter your name:", nameWindow, false, true);
-        draw_lobby_text(0, 100, name + "_", nameWindow, false, true);
-        draw_lobby_text(0, nameWindow.getSize().y - 40, "Press Enter when done", nameWindow, false, true);
-        
-        nameWindow.display();
-    }
-    
-    return name.empty() ? "Player" : name;
+void Pacman::set_animation_timer(unsigned short value)
+{
+   animation_timer = value;
+}
+
+void Pacman::set_energizer_timer(unsigned short value)
+{
+   energizer_timer = value;
+}
+
+void Pacman::set_dead(bool value)
+{
+   dead = value;
+
+   if (dead)
+   {
+      animation_timer = 0;
+   }
+}
+
+void Pacman::set_position(short x, short y)
+{
+   position = {x, y};
+   previous_position = position;
+}
+
+void Pacman::update(const LevelSettings& settings, array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map, const WallBitboard& wall_bits, unsigned char turn, unsigned char held, int& score, AudioEventQueue& audio_events)
+{
+   // steps never run past a tile edge, and up to there a one pixel probe sees the same walls
+   unsigned char wall_mask = wall_bits.probe(position.x, position.y, 1, 0);
+
+   array<bool, 4> walls{};
+   for (unsigned char a = 0; a < 4; a++)
+   {
+      walls[a] = wall_mask >> a & 1;
+   }
+
+   for (unsigned char a = 0; a < 4; a++)
+   {
+      if ((held >> a & 1) && !walls[a])
+      {
+         direction = a;
+      }
+   }
+
+   // the last direction pressed wins as soon as its wall opens, even after the key was let go
+   if (4 > turn && !walls[turn])
+   {
+      direction = turn;
+   }
+
+   progress += settings.pacman_speed;
+   unsigned char pixels = 0;
+
+   if (!walls[direction])
+   {
+      pixels = fixed_step(progress, position.x, position.y, direction);
+
+      switch (direction)
+      {
+         case 0: position.x += pixels; break;
+         case 1: position.y -= pixels; break;
+         case 2: position.x -= pixels; break;
+         case 3: position.y += pixels; break;
+      }
+   }
+   else
+   {
+      // standing against a wall saves nothing up for later
+      progress &= FIXED_ONE - 1;
+   }
+
+   if (position.x <= -CELL_SIZE)
+   {
+      position.x = CELL_SIZE * MAP_WIDTH - pixels;
+   }
+   else if (position.x >= CELL_SIZE * MAP_WIDTH)
+   {
+      position.x = pixels - CELL_SIZE;
+   }
+
+   
+   bool collected = false;
+   bool energized = 0;
+   // the cells pacman overlaps, rounded down and up by shifts
+   short left = position.x >> CELL_SHIFT;
+   short right = (position.x + CELL_SIZE - 1) >> CELL_SHIFT;
+   short top = position.y >> CELL_SHIFT;
+   short bottom = (position.y + CELL_SIZE - 1) >> CELL_SHIFT;
+   for (unsigned char a = 0; a < 4; a++)
+   {
+      short cx = 1 == a % 2 ? right : left;
+      short cy = 2 <= a ? bottom : top;
+      if (0 <= cx && 0 <= cy && MAP_HEIGHT > cy && MAP_WIDTH > cx)
+      {
+         if (map[cx][cy] == Cell::Energizer)
+         {
+            map[cx][cy] = Cell::Empty;
+            score += settings.energizer_score;
+            energized = 1;
+            audio_events.push(EnergizerEaten);
+         }
+         else if (map[cx][cy] == Cell::Pellet)
+         {
+            map[cx][cy] = Cell::Empty;
+            score += settings.pellet_score;
+            audio_events.push(PelletEaten);
+         }
+      }
+   }
+
+   // the ghosts see the full duration on the tick the energizer goes, that is how they know
+   if (energized)
+   {
+      energizer_timer = settings.energizer_duration;
+   }
+   else if (0 < energizer_timer)
+   {
+      energizer_timer--;
+   }
+}
+
+Position Pacman::get_position() const
+{
+   return position;
+}
+
+// ghost implementation here
+GhostManager::GhostManager(unsigned short in_count) :
+   current_wave(0),
+   wave_timer(LONG_SCATTER_DURATION),
+   count(in_count),
+   home({0, 0}),
+   home_exit({0, 0}),
+   settings(LevelTable::defaults(0)),
+   x(in_count, 0),
+   y(in_count, 0),
+   target_x(in_count, 0),
+   target_y(in_count, 0),
+   behaviour(in_count, 0),
+   direction(in_count, 0),
+   movement_mode(in_count, 0),
+   use_door(in_count, 0),
+   frightened_mode(in_count, 0),
+   speed(in_count, GHOST_SPEED),
+   progress(in_count, 0),
+   step(in_count, 1),
+   moving(in_count, 0),
+   walls(in_count, 0),
+   animation_timer(in_count, 0),
+   previous_x(in_count, 0),
+   previous_y(in_count, 0),
+   target_updates(0),
+   random_state(1)
+{
+}
+
+// squared distance to the target after a one pixel step, which orders directions the same as the distance
+int GhostManager::target_distance(unsigned short ghost, unsigned char direction_override) const
+{
+   int dx = x[ghost] - target_x[ghost];
+   int dy = y[ghost] - target_y[ghost];
+
+   switch (direction_override)
+   {
+      case 0: dx++; break;
+      case 1: dy--; break;
+      case 2: dx--; break;
+      case 3: dy++; break;
+      default: break;
+   }
+
+   return dx * dx + dy * dy;
+}
+
+unsigned char GhostManager::roll_direction()
+{
+   random_state ^= random_state << 13;
+   random_state ^= random_state >> 17;
+   random_state ^= random_state << 5;
+   return static_cast<unsigned char>(random_state >> 30);
+}
+
+// open directions other than straight back
+unsigned char GhostManager::open_ways(unsigned short ghost) const
+{
+   return ~walls[ghost] & 15 & ~(1 << (2 + direction[ghost]) % 4);
+}
+
+bool GhostManager::same_state(const GhostManager& other) const
+{
+   return x == other.x && y == other.y && direction == other.direction && movement_mode == other.movement_mode &&
+          use_door == other.use_door && frightened_mode == other.frightened_mode && progress == other.progress;
+}
+
+void GhostManager::animate()
+{
+   for (unsigned short a = 0; a < count; a++)
+   {
+      animation_timer[a] = (1 + animation_timer[a]) % (GHOST_ANIMATION_FRAMES * GHOST_ANIMATION_SPEED);
+   }
+}
+
+void GhostManager::begin_tick()
+{
+   previous_x = x;
+   previous_y = y;
+}
+
+void GhostManager::draw(bool flash, float alpha, SpriteBatch& batch) const
+{
+   for (unsigned short a = 0; a < count; a++)
+   {
+      float draw_x = interpolate(previous_x[a], x[a], alpha);
+      float draw_y = interpolate(previous_y[a], y[a], alpha);
+      unsigned char body_frame = static_cast<unsigned char>(floor(animation_timer[a] / static_cast<float>(GHOST_ANIMATION_SPEED)));
+
+      IntRect body = atlas_rect(ATLAS_GHOST16, CELL_SIZE * body_frame, 0, CELL_SIZE, CELL_SIZE);
+
+      if (0 == frightened_mode[a])
+      {
+         batch.add(draw_x, draw_y, body, GHOST_COLORS[behaviour[a] % GHOST_COLOR_COUNT]);
+         batch.add(draw_x, draw_y, atlas_rect(ATLAS_GHOST16, CELL_SIZE * direction[a], CELL_SIZE, CELL_SIZE, CELL_SIZE));
+      }
+      else if (1 == frightened_mode[a])
+      {
+         bool flashing = flash && 0 == body_frame % 2;
+         IntRect face = atlas_rect(ATLAS_GHOST16, 4 * CELL_SIZE, CELL_SIZE, CELL_SIZE, CELL_SIZE);
+
+         batch.add(draw_x, draw_y, body, flashing ? Color(255, 255, 255) : Color(36, 36, 255));
+         batch.add(draw_x, draw_y, face, flashing ? Color(255, 0, 0) : Color(255, 255, 255));
+      }
+      else
+      {
+         batch.add(draw_x, draw_y, atlas_rect(ATLAS_GHOST16, CELL_SIZE * direction[a], 2 * CELL_SIZE, CELL_SIZE, CELL_SIZE));
+      }
+   }
+}
+
+// what moves the ghosts later on, drawing state and the per tick scratch arrays left out
+void GhostManager::hash(StateHash& state) const
+{
+   state.add(current_wave);
+   state.add(wave_timer);
+   state.add(count);
+   state.add(x);
+   state.add(y);
+   state.add(target_x);
+   state.add(target_y);
+   state.add(behaviour);
+   state.add(direction);
+   state.add(movement_mode);
+   state.add(use_door);
+   state.add(frightened_mode);
+   state.add(speed);
+   state.add(progress);
+   state.add(random_state);
+}
+
+// ghosts past the fourth cycle through the four spawn points and personalities
+void GhostManager::reset(const LevelSettings& level_settings, const array<Position, 4>& ghost_positions)
+{
+   settings = level_settings;
+   current_wave = 0;
+   wave_timer = settings.long_scatter_duration;
+
+   home = ghost_positions[2];
+   home_exit = ghost_positions[0];
+
+   for (unsigned short a = 0; a < count; a++)
+   {
+      unsigned char b = a % GHOST_BEHAVIOUR_COUNT;
+
+      x[a] = ghost_positions[b].x;
+      y[a] = ghost_positions[b].y;
+      target_x[a] = home_exit.x;
+      target_y[a] = home_exit.y;
+      behaviour[a] = b;
+      direction[a] = 0;
+      movement_mode[a] = 0;
+      use_door[a] = 0 < b;
+      frightened_mode[a] = 0;
+      speed[a] = settings.ghost_speed;
+      progress[a] = 0;
+      step[a] = 1;
+      animation_timer[a] = 0;
+   }
+
+   begin_tick();
+}
+
+// nearby seeds are spread apart first, and xorshift needs a state other than 0
+void GhostManager::seed(Uint32 value)
+{
+   random_state = value * 2654435761u;
+   random_state = random_state ? random_state : 1;
+}
+
+void GhostManager::update(const WallBitboard& wall_bits, const JunctionTable* junctions, const FlowField* chase_field, Pacman& pacman)
+{
+   advance_waves(pacman);
+   update_modes(pacman, 0, count);
+   update_doors(0, count);
+   find_exits(wall_bits, junctions, 0, count);
+
+   // ghost 0 moves before the rest aim, so flankers aim from where it ends up, like the per-ghost loop did
+   update_targets(pacman, !junctions, 0, 1);
+   choose_directions(chase_field, 0, 1);
+   move(0, 1);
+
+   update_targets(pacman, !junctions, 1, count);
+   choose_directions(chase_field, 1, count);
+   move(1, count);
+
+   check_pacman(pacman, 0, count);
+}
+
+void GhostManager::update_one_by_one(const WallBitboard& wall_bits, const JunctionTable* junctions, const FlowField* chase_field, Pacman& pacman)
+{
+   advance_waves(pacman);
+
+   for (unsigned short a = 0; a < count; a++)
+   {
+      update_modes(pacman, a, a + 1);
+      update_doors(a, a + 1);
+      find_exits(wall_bits, junctions, a, a + 1);
+      update_targets(pacman, !junctions, a, a + 1);
+      choose_directions(chase_field, a, a + 1);
+      move(a, a + 1);
+      check_pacman(pacman, a, a + 1);
+   }
+}
+
+void GhostManager::advance_waves(const Pacman& pacman)
+{
+   if (0 == pacman.get_energizer_timer())
+   {
+      if (0 == wave_timer)
+      {
+         if (current_wave < 7)
+         {
+            current_wave++;
+
+            for (unsigned short a = 0; a < count; a++)
+            {
+               movement_mode[a] = 1 - movement_mode[a];
+            }
+         }
+
+         if (1 == current_wave % 2)
+         {
+            wave_timer = settings.chase_duration;
+         }
+         else if (2 == current_wave)
+         {
+            wave_timer = settings.long_scatter_duration;
+         }
+         else
+         {
+            wave_timer = settings.short_scatter_duration;
+         }
+      }
+      else
+      {
+         wave_timer--;
+      }
+   }
+}
+
+void GhostManager::update_modes(Pacman& pacman, unsigned short first, unsigned short last)
+{
+   unsigned short energizer_timer = pacman.get_energizer_timer();
+   bool energizer_eaten = energizer_timer == settings.energizer_duration;
+
+   for (unsigned short a = first; a < last; a++)
+   {
+      if (0 == frightened_mode[a] && energizer_eaten)
+      {
+         frightened_mode[a] = 1;
+      }
+      else if (0 == energizer_timer && 1 == frightened_mode[a])
+      {
+         frightened_mode[a] = 0;
+      }
+
+      speed[a] = 2 == frightened_mode[a] ? settings.escape_speed : 1 == frightened_mode[a] ? settings.frightened_speed : settings.ghost_speed;
+      progress[a] += speed[a];
+      step[a] = static_cast<unsigned char>(max(1, min(progress[a] >> FIXED_SHIFT, static_cast<int>(pixels_to_edge(x[a], y[a], direction[a])))));
+   }
+}
+
+void GhostManager::update_doors(unsigned short first, unsigned short last)
+{
+   for (unsigned short a = first; a < last; a++)
+   {
+      if (use_door[a] && x[a] == target_x[a] && y[a] == target_y[a])
+      {
+         if (home_exit.x == target_x[a] && home_exit.y == target_y[a])
+         {
+            use_door[a] = 0;
+         }
+         else if (home.x == target_x[a] && home.y == target_y[a])
+         {
+            frightened_mode[a] = 0;
+            target_x[a] = home_exit.x;
+            target_y[a] = home_exit.y;
+         }
+      }
+   }
+}
+
+void GhostManager::find_exits(const WallBitboard& wall_bits, const JunctionTable* junctions, unsigned short first, unsigned short last)
+{
+   if (!junctions)
+   {
+      wall_bits.probe_all(x.data() + first, y.data() + first, step.data() + first, use_door.data() + first, walls.data() + first, last - first);
+      return;
+   }
+
+   for (unsigned short a = first; a < last; a++)
+   {
+      unsigned char exits = junctions->exits_at(x[a], y[a], use_door[a]);
+      walls[a] = JUNCTION_OFF_AXIS == exits ? wall_bits.probe(x[a], y[a], step[a], use_door[a]) : ~exits & 15;
+   }
+}
+
+void GhostManager::update_targets(Pacman& pacman, bool every_ghost, unsigned short first, unsigned short last)
+{
+   Position pacman_position = pacman.get_position();
+   unsigned char pacman_direction = pacman.get_direction();
+
+   short lead_x = 0;
+   short lead_y = 0;
+
+   switch (pacman_direction)
+   {
+      case 0: lead_x = CELL_SIZE; break;
+      case 1: lead_y = -CELL_SIZE; break;
+      case 2: lead_x = -CELL_SIZE; break;
+      case 3: lead_y = CELL_SIZE; break;
+      default: break;
+   }
+
+   // flankers work off ghost 0 where it is now, update has moved it by the time the others aim
+   short leader_x = x[0];
+   short leader_y = y[0];
+
+   for (unsigned short a = first; a < last; a++)
+   {
+      // ghosts going through the door already have their target, the rest only need one where they choose
+      if (use_door[a] || (!every_ghost && (1 == frightened_mode[a] || 0 == (open_ways(a) & (open_ways(a) - 1)))))
+      {
+         continue;
+      }
+
+      target_updates++;
+
+      const GhostBehaviour& personality = GHOST_BEHAVIOURS[behaviour[a]];
+
+      if (0 == movement_mode[a])
+      {
+         target_x[a] = personality.scatter.x;
+         target_y[a] = personality.scatter.y;
+         continue;
+      }
+
+      short tx = pacman_position.x + lead_x * personality.lead;
+      short ty = pacman_position.y + lead_y * personality.lead;
+
+      if (personality.flank)
+      {
+         tx += tx - leader_x;
+         ty += ty - leader_y;
+      }
+
+      if (personality.shy)
+      {
+         int dx = x[a] - pacman_position.x;
+         int dy = y[a] - pacman_position.y;
+         int radius = CELL_SIZE * personality.shy;
+
+         if (dx * dx + dy * dy < radius * radius)
+         {
+            tx = personality.scatter.x;
+            ty = personality.scatter.y;
+         }
+      }
+
+      target_x[a] = tx;
+      target_y[a] = ty;
+   }
+}
+
+void GhostManager::choose_directions(const FlowField* chase_field, unsigned short first, unsigned short last)
+{
+   for (unsigned short a = first; a < last; a++)
+   {
+      unsigned char reverse = (2 + direction[a]) % 4;
+
+      moving[a] = 0;
+
+      if (1 != frightened_mode[a])
+      {
+         unsigned char ways = open_ways(a);
+         // one way on is a corridor or a corner, only junctions compare distances
+         bool junction = 0 != (ways & (ways - 1));
+         unsigned char optimal_direction = 4;
+         int optimal_distance = 0;
+         moving[a] = FIXED_ONE <= progress[a];
+
+         if (junction && chase_field && !use_door[a] && chase_field->targets(target_x[a], target_y[a]))
+         {
+            optimal_direction = chase_field->next_direction(x[a], y[a], ways);
+         }
+
+         for (unsigned char b = 0; 4 == optimal_direction && b < 4; b++)
+         {
+            if (!(ways >> b & 1))
+            {
+               continue;
+            }
+            else if (!junction)
+            {
+               optimal_direction = b;
+               break;
+            }
+
+            int distance = target_distance(a, b);
+
+            if (4 == optimal_direction || distance < optimal_distance)
+            {
+               optimal_direction = b;
+               optimal_distance = distance;
+            }
+         }
+
+         direction[a] = 4 == optimal_direction ? reverse : optimal_direction;
+      }
+      else
+      {
+         unsigned char random_direction = roll_direction();
+
+         // a new way is only picked on the ticks the ghost gets a pixel further
+         if (FIXED_ONE <= progress[a])
+         {
+            moving[a] = 1;
+
+            if (0 != open_ways(a))
+            {
+               while ((walls[a] >> random_direction & 1) || random_direction == reverse)
+               {
+                  random_direction = roll_direction();
+               }
+
+               direction[a] = random_direction;
+            }
+            else
+            {
+               direction[a] = reverse;
+            }
+         }
+      }
+   }
+}
+
+void GhostManager::move(unsigned short first, unsigned short last)
+{
+   static const short step_x[4] = {1, 0, -1, 0};
+   static const short step_y[4] = {0, -1, 0, 1};
+
+   for (unsigned short a = first; a < last; a++)
+   {
+      unsigned char pixels = moving[a] ? fixed_step(progress[a], x[a], y[a], direction[a]) : 0;
+
+      x[a] += pixels * step_x[direction[a]];
+      y[a] += pixels * step_y[direction[a]];
+
+      if (x[a] <= -CELL_SIZE)
+      {
+         x[a] = CELL_SIZE * MAP_WIDTH - pixels;
+      }
+      else if (x[a] >= CELL_SIZE * MAP_WIDTH)
+      {
+         x[a] = pixels - CELL_SIZE;
+      }
+   }
+}
+
+void GhostManager::check_pacman(Pacman& pacman, unsigned short first, unsigned short last)
+{
+   Position pacman_position = pacman.get_position();
+
+   for (unsigned short a = first; a < last; a++)
+   {
+      if (x[a] > pacman_position.x - CELL_SIZE && x[a] < CELL_SIZE + pacman_position.x &&
+          y[a] > pacman_position.y - CELL_SIZE && y[a] < CELL_SIZE + pacman_position.y)
+      {
+         if (0 == frightened_mode[a])
+         {
+            pacman.set_dead(1);
+         }
+         else
+         {
+            use_door[a] = 1;
+            frightened_mode[a] = 2;
+            target_x[a] = home.x;
+            target_y[a] = home.y;
+         }
+      }
+   }
+}
+
+WallBitboard::WallBitboard() :
+   rows{}
+{
+}
+
+void WallBitboard::build(const array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map)
+{
+   for (unsigned char a = 0; a < MAP_HEIGHT; a++)
+   {
+      Uint32 walls = 0;
+      Uint32 doors = 0;
+
+      for (unsigned char b = 0; b < MAP_WIDTH; b++)
+      {
+         walls |= static_cast<Uint32>(Cell::Wall == map[b][a]) << (WALL_PADDING + b);
+         doors |= static_cast<Uint32>(Cell::Door == map[b][a]) << (WALL_PADDING + b);
+      }
+
+      rows[0][WALL_PADDING + a] = walls | doors;
+      rows[1][WALL_PADDING + a] = walls;
+   }
+}
+
+// the four cells under the corners, >> floors negative positions as well
+bool WallBitboard::blocked(int x, int y, bool use_door) const
+{
+   int left = (x >> CELL_SHIFT) + WALL_PADDING;
+   int right = ((x + CELL_SIZE - 1) >> CELL_SHIFT) + WALL_PADDING;
+   int top = (y >> CELL_SHIFT) + WALL_PADDING;
+   int bottom = ((y + CELL_SIZE - 1) >> CELL_SHIFT) + WALL_PADDING;
+
+   Uint32 bits = (0 <= left && left < 32 ? 1u << left : 0) | (0 <= right && right < 32 ? 1u << right : 0);
+   Uint32 row = (0 <= top && top < WALL_ROWS ? rows[use_door][top] : 0) | (0 <= bottom && bottom < WALL_ROWS ? rows[use_door][bottom] : 0);
+
+   return 0 != (row & bits);
+}
+
+unsigned char WallBitboard::probe(short x, short y, unsigned char speed, bool use_door) const
+{
+   return blocked(x + speed, y, use_door)
+        | blocked(x, y - speed, use_door) << 1
+        | blocked(x - speed, y, use_door) << 2
+        | blocked(x, y + speed, use_door) << 3;
+}
+
+void WallBitboard::probe_all_scalar(const short* x, const short* y, const unsigned char* speed, const unsigned char* use_door, unsigned char* walls, unsigned short count) const
+{
+   for (unsigned short a = 0; a < count; a++)
+   {
+      walls[a] = probe(x[a], y[a], speed[a], use_door[a]);
+   }
+}
+
+void WallBitboard::probe_all(const short* x, const short* y, const unsigned char* speed, const unsigned char* use_door, unsigned char* walls, unsigned short count) const
+{
+#ifdef WALL_PROBE_AVX2
+   static const bool avx2 = __builtin_cpu_supports("avx2");
+
+   if (avx2)
+   {
+      probe_avx2(x, y, speed, use_door, walls, count);
+      return;
+   }
+#endif
+
+   probe_all_scalar(x, y, speed, use_door, walls, count);
+}
+
+#ifdef WALL_PROBE_AVX2
+// eight entities per iteration: cell indices by shifts, rows by gather, cells by variable shifts.
+// Rows outside the board clamp onto the empty padding rows, columns outside shift to 0
+__attribute__((target("avx2")))
+void WallBitboard::probe_avx2(const short* x, const short* y, const unsigned char* speed, const unsigned char* use_door, unsigned char* walls, unsigned short count) const
+{
+   const int* board = reinterpret_cast<const int*>(&rows[0][0]);
+
+   const __m256i zero = _mm256_setzero_si256();
+   const __m256i one = _mm256_set1_epi32(1);
+   const __m256i padding = _mm256_set1_epi32(WALL_PADDING);
+   const __m256i round_up = _mm256_set1_epi32(CELL_SIZE - 1);
+   const __m256i last_row = _mm256_set1_epi32(WALL_ROWS - 1);
+   const __m256i door_rows = _mm256_set1_epi32(WALL_ROWS);
+
+   unsigned short a = 0;
+
+   for (; a + 8 <= count; a += 8)
+   {
+      __m256i px = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(x + a)));
+      __m256i py = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(y + a)));
+      __m256i ps = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(speed + a)));
+      __m256i base = _mm256_mullo_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(use_door + a))), door_rows);
+
+      __m256i mask = zero;
+
+      for (unsigned char b = 0; b < 4; b++)
+      {
+         __m256i qx = 0 == b ? _mm256_add_epi32(px, ps) : 2 == b ? _mm256_sub_epi32(px, ps) : px;
+         __m256i qy = 1 == b ? _mm256_sub_epi32(py, ps) : 3 == b ? _mm256_add_epi32(py, ps) : py;
+
+         __m256i left = _mm256_add_epi32(_mm256_srai_epi32(qx, CELL_SHIFT), padding);
+         __m256i right = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(qx, round_up), CELL_SHIFT), padding);
+         __m256i top = _mm256_add_epi32(_mm256_srai_epi32(qy, CELL_SHIFT), padding);
+         __m256i bottom = _mm256_add_epi32(_mm256_srai_epi32(_mm256_add_epi32(qy, round_up), CELL_SHIFT), padding);
+
+         top = _mm256_add_epi32(base, _mm256_min_epi32(_mm256_max_epi32(top, zero), last_row));
+         bottom = _mm256_add_epi32(base, _mm256_min_epi32(_mm256_max_epi32(bottom, zero), last_row));
+
+         __m256i row = _mm256_or_si256(_mm256_i32gather_epi32(board, top, 4), _mm256_i32gather_epi32(board, bottom, 4));
+         __m256i bits = _mm256_or_si256(_mm256_sllv_epi32(one, left), _mm256_sllv_epi32(one, right));
+         __m256i free = _mm256_cmpeq_epi32(_mm256_and_si256(row, bits), zero);
+
+         mask = _mm256_or_si256(mask, _mm256_andnot_si256(free, _mm256_set1_epi32(1 << b)));
+      }
+
+      alignas(32) int lanes[8];
+      _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), mask);
+
+      for (unsigned char b = 0; b < 8; b++)
+      {
+         walls[a + b] = static_cast<unsigned char>(lanes[b]);
+      }
+   }
+
+   probe_all_scalar(x + a, y + a, speed + a, use_door + a, walls + a, count - a);
+}
+#endif
+
+JunctionTable::JunctionTable() :
+   exits{}
+{
+}
+
+void JunctionTable::build(const array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map)
+{
+   static const char step_x[4] = {1, 0, -1, 0};
+   static const char step_y[4] = {0, -1, 0, 1};
+
+   for (unsigned char use_door = 0; use_door < 2; use_door++)
+   {
+      for (short a = 0; a < MAP_WIDTH + 2 * WALL_PADDING; a++)
+      {
+         for (short b = 0; b < MAP_HEIGHT + 2 * WALL_PADDING; b++)
+         {
+            exits[use_door][a][b] = 0;
+
+            for (unsigned char c = 0; c < 4; c++)
+            {
+               short cx = a - WALL_PADDING + step_x[c];
+               short cy = b - WALL_PADDING + step_y[c];
+               bool blocked = 0;
+
+               if (0 <= cx && cx < MAP_WIDTH && 0 <= cy && cy < MAP_HEIGHT)
+               {
+                  blocked = Cell::Wall == map[cx][cy] || (!use_door && Cell::Door == map[cx][cy]);
+               }
+
+               exits[use_door][a][b] |= !blocked << c;
+            }
+         }
+      }
+   }
+}
+
+unsigned char JunctionTable::exits_at(short x, short y, bool use_door) const
+{
+   const unsigned char horizontal = 1 << 0 | 1 << 2;
+   const unsigned char vertical = 1 << 1 | 1 << 3;
+
+   short cx = (x >> CELL_SHIFT) + WALL_PADDING;
+   short cy = (y >> CELL_SHIFT) + WALL_PADDING;
+   bool between_x = 0 != (x & (CELL_SIZE - 1));
+   bool between_y = 0 != (y & (CELL_SIZE - 1));
+
+   if (between_x && between_y)
+   {
+      return JUNCTION_OFF_AXIS;
+   }
+   else if (between_x)
+   {
+      return (exits[use_door][cx][cy] & exits[use_door][1 + cx][cy] & vertical) | horizontal;
+   }
+   else if (between_y)
+   {
+      return (exits[use_door][cx][cy] & exits[use_door][cx][1 + cy] & horizontal) | vertical;
+   }
+
+   return exits[use_door][cx][cy];
+}
+
+FlowField::FlowField() :
+   open{},
+   distance{},
+   target({-1, -1}),
+   searches(0),
+   settled_tiles(0)
+{
+}
+
+// the tile an entity mostly covers, off the edge of the tunnel counts as the tile it wraps to
+Position FlowField::tile_at(short x, short y)
+{
+   short cx = (x + CELL_SIZE / 2) >> CELL_SHIFT;
+   short cy = (y + CELL_SIZE / 2) >> CELL_SHIFT;
+
+   return {static_cast<short>((cx + MAP_WIDTH) % MAP_WIDTH), static_cast<short>(max<short>(0, min<short>(MAP_HEIGHT - 1, cy)))};
+}
+
+bool FlowField::neighbour(const Position& tile, unsigned char direction, Position& next)
+{
+   static const short step_x[4] = {1, 0, -1, 0};
+   static const short step_y[4] = {0, -1, 0, 1};
+
+   next.x = static_cast<short>((tile.x + step_x[direction] + MAP_WIDTH) % MAP_WIDTH);
+   next.y = static_cast<short>(tile.y + step_y[direction]);
+
+   return 0 <= next.y && next.y < MAP_HEIGHT;
+}
+
+bool FlowField::is_target(const Position& tile) const
+{
+   return tile.x == target.x && tile.y == target.y;
+}
+
+bool FlowField::reachable(const Position& tile) const
+{
+   return 0 <= tile.x && open[tile.x][tile.y];
+}
+
+void FlowField::build(const array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map)
+{
+   for (unsigned char a = 0; a < MAP_WIDTH; a++)
+   {
+      for (unsigned char b = 0; b < MAP_HEIGHT; b++)
+      {
+         open[a][b] = Cell::Wall != map[a][b] && Cell::Door != map[a][b];
+      }
+   }
+
+   target = {-1, -1};
+}
+
+void FlowField::set_target(const Position& position)
+{
+   Position tile = tile_at(position.x, position.y);
+
+   if (is_target(tile))
+   {
+      return;
+   }
+
+   target = tile;
+   search();
+}
+
+void FlowField::search()
+{
+   for (array<unsigned short, MAP_HEIGHT>& column : distance)
+   {
+      column.fill(FLOW_UNREACHED);
+   }
+
+   searches++;
+
+   if (!reachable(target))
+   {
+      return;
+   }
+
+   distance[target.x][target.y] = 0;
+   lower(target);
+}
+
+void FlowField::lower(const Position& tile)
+{
+   SimpleQueue<Position, 1 + MAP_WIDTH * MAP_HEIGHT> queue;
+   queue.push(tile);
+
+   while (!queue.empty())
+   {
+      Position current = queue.top();
+      queue.pop();
+
+      for (unsigned char a = 0; a < 4; a++)
+      {
+         Position next;
+
+         if (neighbour(current, a, next) && open[next.x][next.y] && 1 + distance[current.x][current.y] < distance[next.x][next.y])
+         {
+            distance[next.x][next.y] = 1 + distance[current.x][current.y];
+            queue.push(next);
+            settled_tiles++;
+         }
+      }
+   }
+}
+
+bool FlowField::targets(short x, short y) const
+{
+   return is_target(tile_at(x, y));
+}
+
+bool FlowField::same_distances(const FlowField& other) const
+{
+   return distance == other.distance;
+}
+
+unsigned char FlowField::next_direction(short x, short y, unsigned char ways) const
+{
+   Position tile = tile_at(x, y);
+   unsigned char best_direction = 4;
+   unsigned short best_distance = FLOW_UNREACHED;
+
+   for (unsigned char a = 0; a < 4; a++)
+   {
+      Position next;
+
+      if ((ways >> a & 1) && neighbour(tile, a, next) && distance[next.x][next.y] < best_distance)
+      {
+         best_direction = a;
+         best_distance = distance[next.x][next.y];
+      }
+   }
+
+   return best_direction;
+}
+
+\
+bool map_collision(bool collect_pellets, bool use_door, short x, short y, array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map)
+{
+   bool output = 0;
+
+   // the cells the square at x, y overlaps, rounded down and up by shifts
+   short left = x >> CELL_SHIFT;
+   short right = (x + CELL_SIZE - 1) >> CELL_SHIFT;
+   short top = y >> CELL_SHIFT;
+   short bottom = (y + CELL_SIZE - 1) >> CELL_SHIFT;
+
+   for (unsigned char a = 0; a < 4; a++)
+   {
+      short cx = 1 == a % 2 ? right : left;
+      short cy = 2 <= a ? bottom : top;
+
+      if (0 <= cx && 0 <= cy && MAP_HEIGHT > cy && MAP_WIDTH > cx)
+      {
+         if (!collect_pellets)
+         {
+            if (Cell::Wall == map[cx][cy])
+            {
+               output = 1;
+            }
+            else if (!use_door && Cell::Door == map[cx][cy])
+            {
+               output = 1;
+            }
+         }
+         else
+         {
+            if (Cell::Energizer == map[cx][cy])
+            {
+               output = 1;
+               map[cx][cy] = Cell::Empty;
+            }
+            else if (Cell::Pellet == map[cx][cy])
+            {
+               map[cx][cy] = Cell::Empty;
+            }
+         }
+      }
+   }
+
+   return output;
+}
+
+array<array<Cell, MAP_HEIGHT>, MAP_WIDTH> convert_sketch(const array<string, MAP_HEIGHT>& map_sketch, array<Position, 4>& ghost_positions, Pacman& pacman)
+{
+   array<array<Cell, MAP_HEIGHT>, MAP_WIDTH> output_map{};
+
+   for (unsigned char a = 0; a < MAP_HEIGHT; a++)
+   {
+      for (unsigned char b = 0; b < MAP_WIDTH; b++)
+      {
+         output_map[b][a] = Cell::Empty;
+
+         switch (map_sketch[a][b])
+         {
+            case '#':
+               output_map[b][a] = Cell::Wall;
+               break;
+            case '=':
+               output_map[b][a] = Cell::Door;
+               break;
+            case '.':
+               output_map[b][a] = Cell::Pellet;
+               break;
+            case '0':
+               ghost_positions[0] = {static_cast<short>(CELL_SIZE * b), static_cast<short>(CELL_SIZE * a)};
+               break;
+            case '1':
+               ghost_positions[1] = {static_cast<short>(CELL_SIZE * b), static_cast<short>(CELL_SIZE * a)};
+               break;
+            case '2':
+               ghost_positions[2] = {static_cast<short>(CELL_SIZE * b), static_cast<short>(CELL_SIZE * a)};
+               break;
+            case '3':
+               ghost_positions[3] = {static_cast<short>(CELL_SIZE * b), static_cast<short>(CELL_SIZE * a)};
+               break;
+            case 'P':
+               pacman.set_position(static_cast<short>(CELL_SIZE * b), static_cast<short>(CELL_SIZE * a));
+               break;
+            case 'o':
+               output_map[b][a] = Cell::Energizer;
+               break;
+            default:
+               break;
+         }
+      }
+   }
+
+   return output_map;
+}
+
+// where a cell's sprite sits in the atlas, walls pick theirs from the walls around them.
+// Cells drawn as nothing get an empty rect
+IntRect map_cell_rect(const array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map, unsigned char a, unsigned char b)
+{
+   switch (map[a][b])
+   {
+      case Cell::Door:
+         return atlas_rect(ATLAS_MAP16, 2 * CELL_SIZE, CELL_SIZE, CELL_SIZE, CELL_SIZE);
+      case Cell::Energizer:
+         return atlas_rect(ATLAS_MAP16, CELL_SIZE, CELL_SIZE, CELL_SIZE, CELL_SIZE);
+      case Cell::Pellet:
+         return atlas_rect(ATLAS_MAP16, 0, CELL_SIZE, CELL_SIZE, CELL_SIZE);
+      case Cell::Wall:
+      {
+         bool down = 0;
+         bool left = 0;
+         bool right = 0;
+         bool up = 0;
+
+         if (b < MAP_HEIGHT - 1 && Cell::Wall == map[a][1 + b]) { down = 1; }
+         if (0 < a)
+         {
+            if (Cell::Wall == map[a - 1][b]) { left = 1; }
+         }
+         else
+         {
+            left = 1;
+         }
+
+         if (a < MAP_WIDTH - 1)
+         {
+            if (Cell::Wall == map[a + 1][b]) { right = 1; }
+         }
+         else
+         {
+            right = 1;
+         }
+
+         if (0 < b && Cell::Wall == map[a][b - 1]) { up = 1; }
+
+         return atlas_rect(ATLAS_MAP16, CELL_SIZE * (down + 2 * (left + 2 * (right + 2 * up))), 0, CELL_SIZE, CELL_SIZE);
+      }
+      default:
+         return IntRect();
+   }
+}
+
+void draw_map(const array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map, RenderTarget& window, bool static_cells)
+{
+Sprite sprite;
+   sprite.setTexture(get_atlas());
+
+   for (unsigned char a = 0; a < MAP_WIDTH; a++)
+   {
+      for (unsigned char b = 0; b < MAP_HEIGHT; b++)
+      {
+         bool static_cell = Cell::Door == map[a][b] || Cell::Wall == map[a][b];
+         IntRect rect = map_cell_rect(map, a, b);
+
+         if (static_cell != static_cells || 0 == rect.width)
+         {
+            continue;
+         }
+
+         sprite.setPosition(static_cast<float>(CELL_SIZE * a), static_cast<float>(CELL_SIZE * b));
+         sprite.setTextureRect(rect);
+         window.draw(sprite);
+      }
+   }
+}
+
+void draw_text(bool center, unsigned short x, unsigned short y, const string& text, RenderTarget& window)
+{
+   short character_x = x;
+   short character_y = y;
+
+Sprite sprite;
+   unsigned char character_width = static_cast<unsigned char>(ATLAS_FONT.width / 96);
+
+   sprite.setTexture(get_atlas());
+
+   if (center)
+   {
+      character_x = static_cast<short>(round(0.5f * (CELL_SIZE * MAP_WIDTH - character_width * text.substr(0, text.find_first_of('\n')).size())));
+      character_y = static_cast<short>(round(0.5f * (CELL_SIZE * MAP_HEIGHT - FONT_HEIGHT * (1 + count(text.begin(), text.end(), '\n')))));
+   }
+
+   for (string::const_iterator it = text.begin(); it != text.end(); ++it)
+   {
+      if ('\n' == *it)
+      {
+         if (center)
+         {
+            const size_t offset = 1 + static_cast<size_t>(it - text.begin());
+            const size_t next_break = text.find_first_of('\n', offset);
+            const size_t len = (next_break == string::npos ? text.size() : next_break) - offset;
+            character_x = static_cast<short>(round(0.5f * (CELL_SIZE * MAP_WIDTH - character_width * text.substr(offset, len).size())));
+         }
+         else
+         {
+            character_x = x;
+         }
+
+         character_y += FONT_HEIGHT;
+         continue;
+      }
+
+      sprite.setPosition(character_x, character_y);
+      sprite.setTextureRect(atlas_rect(ATLAS_FONT, character_width * (*it - 32), 0, character_width, FONT_HEIGHT));
+
+      character_x += character_width;
+
+      window.draw(sprite);
+   }
+}
+
+// one line of text laid out like draw_text does without centering
+void append_text_quads(VertexArray& vertices, unsigned short x, unsigned short y, const string& text)
+{
+   unsigned char character_width = static_cast<unsigned char>(ATLAS_FONT.width / 96);
+   float character_x = x;
+
+   for (char character : text)
+   {
+      append_quad(vertices, character_x, y, atlas_rect(ATLAS_FONT, character_width * (character - 32), 0, character_width, FONT_HEIGHT));
+      character_x += character_width;
+   }
+}
+
+// a HUD element that keeps its quads and only rebuilds them when its value changes
+class HudWidget
+{
+   int value;
+   bool valid;
+   unsigned updates;
+
+protected:
+   VertexArray vertices;
+
+   virtual void build(int value) = 0;
+
+public:
+   HudWidget() : value(0), valid(0), updates(0), vertices(Quads) {}
+   virtual ~HudWidget() {}
+
+   void set(int in_value)
+   {
+      if (valid && in_value == value)
+      {
+         return;
+      }
+
+      value = in_value;
+      valid = 1;
+      updates++;
+
+      vertices.clear();
+      build(value);
+   }
+
+   void invalidate() { valid = 0; }
+   unsigned get_updates() const { return updates; }
+
+   void draw(RenderTarget& window) const
+   {
+      window.draw(vertices, RenderStates(&get_atlas()));
+   }
+};
+
+class HudLabel : public HudWidget
+{
+   string label;
+   unsigned short x;
+   unsigned short y;
+
+   void build(int value) override
+   {
+      append_text_quads(vertices, x, y, label + to_string(value));
+   }
+
+public:
+   HudLabel(const string& in_label, unsigned short in_x, unsigned short in_y) : label(in_label), x(in_x), y(in_y) {}
+};
+
+// hearts are laid out right aligned from the top right corner, three to the sheet
+class HudHearts : public HudWidget
+{
+   void build(int lives) override
+   {
+      unsigned short heart_width = static_cast<unsigned short>(ATLAS_HEART.width / 3);
+
+      if (lives > 0 && lives <= 3)
+      {
+         unsigned short visible_width = heart_width * lives;
+         append_quad(vertices, CELL_SIZE * MAP_WIDTH - 8 - visible_width, 4, atlas_rect(ATLAS_HEART, 0, 0, visible_width, ATLAS_HEART.height));
+      }
+   }
+};
+
+// level, score and lives, fed from the simulation and drawn from cached quads
+class Hud
+{
+   HudLabel level;
+   HudLabel score;
+   HudHearts lives;
+   unsigned frames;
+
+public:
+   Hud() :
+      level("Level: ", 0, CELL_SIZE * MAP_HEIGHT),
+      score("Score: ", 0, CELL_SIZE * MAP_HEIGHT + FONT_HEIGHT),
+      frames(0)
+   {
+   }
+
+   void update(unsigned char in_level, int in_score, unsigned char in_lives)
+   {
+      level.set(1 + in_level);
+      score.set(in_score);
+      lives.set(in_lives);
+   }
+
+   void draw(RenderTarget& window)
+   {
+      level.draw(window);
+      score.draw(window);
+      lives.draw(window);
+      frames++;
+   }
+
+   // how often each widget rebuilt compared to how often the HUD was drawn
+   void report() const
+   {
+      if (frames)
+      {
+         std::cout << "HUD: " << frames << " frames, rebuilt level " << level.get_updates() << ", score " << score.get_updates()
+                   << ", lives " << lives.get_updates() << " times.\n";
+      }
+   }
+};
+
+// for scores records used linked lists bcz it always insert the score in sorting order 
+struct ScoreNode {
+    std::string name;
+    int score;
+    ScoreNode* next;
+    ScoreNode(const std::string& n, int s) : name(n), score(s), next(nullptr) {}
+};
+
+class ScoreList {
+    ScoreNode* head;
+public:
+    ScoreList() : head(nullptr) {}
+    ~ScoreList() { clear(); }
+    
+    // always add the score in sorting order
+    void add(const std::string& name, int scr) {
+   
+        ScoreNode* node = new ScoreNode(name, scr);
+        
+    
+        if (!head || scr > head->score) {
+            node->next = head; 
+            head = node;
+        } else {
+            
+            ScoreNode* cur = head;
+            while (cur->next && cur->next->score >= scr) {
+                cur = cur->next;  
+            }
+            
+            node->next = cur->next; 
+            cur->next = node;
+        }
+        
+       // always show the top 5 highest scores in sorted order of linked list
+        ScoreNode* cur = head; 
+        int count = 1;
+        while (cur && cur->next) {
+            if (count == 5) {
+                
+                ScoreNode* del = cur->next; 
+                cur->next = nullptr;
+                while(del) { 
+                    ScoreNode* nxt = del->next; 
+                    delete del;  // easy to dlt the score
+                    del = nxt; 
+                }
+                break;
+            }
+            cur = cur->next; 
+            ++count;
+        }
+    }
+    
+    // displaying the score in view score
+    string getListInfo() {
+        std::string info = "Linked List: ";
+        ScoreNode* cur = head;
+        int count = 0;
+        while (cur && count < 5) {
+            info += cur->name + "(" + std::to_string(cur->score) + ")";
+            if (cur->next) info += " -> ";
+            cur = cur->next;
+            count++;
+        }
+        if (!head) info += "Empty";
+        return info;
+    }
+    
+   //  counting the total no of records
+    int getNodeCount() {
+        int count = 0;
+        ScoreNode* cur = head;
+        while (cur) {
+            count++;
+            cur = cur->next;
+        }
+        return count;
+    }
+    
+    ScoreNode* getHead() { return head; }  
+    
+   
+    void clear() {
+        while(head) { 
+            ScoreNode* nxt = head->next; 
+            delete head;  
+            head = nxt;  
+        }
+    }
+};
+
+// screens share one window, the stack decides which one gets events and draws
+enum SceneName
+{
+   LobbyScreen,
+   ScoresScreen,
+   NameEntryScreen,
+   GameScreen,
+   PauseScreen
+};
+
+constexpr unsigned char SCENE_COUNT = 5;
+
+// one part of the frame cached in a RenderTexture, redrawn only after invalidate()
+class RenderLayer
+{
+   RenderTexture texture;
+   Sprite sprite;
+   bool created;
+   bool dirty;
+
+public:
+   RenderLayer() : created(0), dirty(1) {}
+
+   void invalidate() { dirty = 1; }
+
+   // render is called with the layer's texture when it is dirty, the cached quad is drawn either way
+   template <typename Render>
+   void draw(RenderTarget& window, unsigned short width, unsigned short height, Render render)
+   {
+      if (!created)
+      {
+         created = texture.create(width, height);
+         sprite.setTexture(texture.getTexture(), 1);
+         dirty = 1;
+      }
+
+      // no render texture support, draw straight to the window every time
+      if (!created)
+      {
+         render(window);
+         return;
+      }
+
+      if (dirty)
+      {
+         texture.clear(Color::Transparent);
+         render(texture);
+         texture.display();
+         dirty = 0;
+      }
+
+      window.draw(sprite);
+   }
+};
+
+class Scene
+{
+public:
+   virtual ~Scene() {}
+
+   // enter and exit run on every transition, resources stay loaded in between
+   virtual void enter() {}
+   virtual void exit() {}
+   virtual void handle_event(const Event& event) = 0;
+   // returns 1 when the screen changed and has to be drawn again
+   virtual bool update() { return 1; }
+   virtual void draw() = 0;
+   // how long the loop may sleep waiting for input when update had nothing new, zero never sleeps
+   virtual Time idle_wait() const { return Time::Zero; }
+   // the frame drawn last has just been handed to display()
+   virtual void presented() {}
+   // 1 while the screen draws and displays from a thread of its own, the loop then leaves the window alone
+   virtual bool draws_itself() const { return 0; }
+};
+
+// SFML 2.5 has no waitEvent with a timeout, so the wait polls in short sleeps until input or the timeout
+constexpr unsigned char EVENT_WAIT_SLICE_MS = 4;
+constexpr unsigned char MENU_IDLE_WAIT_MS = 50;
+
+bool wait_event(Window& window, Event& event, Time timeout)
+{
+   Clock clock;
+
+   while (!window.pollEvent(event))
+   {
+      Time left = timeout - clock.getElapsedTime();
+
+      if (Time::Zero >= left)
+      {
+         return 0;
+      }
+
+      sf::sleep(min(left, milliseconds(EVENT_WAIT_SLICE_MS)));
+   }
+
+   return 1;
+}
+
+// redraws of a screen while it is shown, printed when it is left
+class RedrawMeter
+{
+   Clock clock;
+   unsigned redraws;
+
+public:
+   RedrawMeter() : redraws(0) {}
+
+   void start()
+   {
+      clock.restart();
+      redraws = 0;
+   }
+
+   void count() { redraws++; }
+
+   void report(const char* screen) const
+   {
+      float shown = clock.getElapsedTime().asSeconds();
+
+      std::cout << screen << ": " << redraws << " redraws in " << shown << " s, " << (0 < shown ? redraws / shown : 0) << " per second\n";
+   }
+};
+
+// screens that only change on input or a loader tick, drawn when marked and asleep otherwise
+class MenuScene : public Scene
+{
+   const char* screen;
+   RedrawMeter meter;
+   bool dirty;
+
+protected:
+   explicit MenuScene(const char* in_screen) : screen(in_screen), dirty(1) {}
+
+   void redraw() { dirty = 1; }
+   virtual void draw_menu() = 0;
+
+public:
+   void enter() override
+   {
+      dirty = 1;
+      meter.start();
+   }
+
+   void exit() override { meter.report(screen); }
+
+   bool update() override
+   {
+      bool changed = dirty;
+      dirty = 0;
+
+      return changed;
+   }
+
+   void draw() override
+   {
+      meter.count();
+      draw_menu();
+   }
+
+   Time idle_wait() const override { return milliseconds(MENU_IDLE_WAIT_MS); }
+};
+
+class SceneStack
+{
+   array<Scene*, SCENE_COUNT> scenes;
+   SimpleStack<Scene*, SCENE_COUNT> stack;
+
+public:
+   SceneStack() { scenes.fill(nullptr); }
+
+   void add(SceneName name, Scene& scene) { scenes[name] = &scene; }
+
+   void push(SceneName name)
+   {
+      stack.push(scenes[name]);
+      scenes[name]->enter();
+   }
+
+   void pop()
+   {
+      if (!stack.empty())
+      {
+         Scene* scene = stack.top();
+         stack.pop();
+         scene->exit();
+      }
+   }
+
+   void replace(SceneName name)
+   {
+      pop();
+      push(name);
+   }
+
+   void clear()
+   {
+      while (!stack.empty())
+      {
+         pop();
+      }
+   }
+
+   bool empty() const { return stack.empty(); }
+   Scene* top() { return stack.top(); }
+};
+
+// everything the screens share, owned by main()
+struct SceneContext
+{
+   RenderWindow& window;
+   SceneStack& scenes;
+   MusicManager& music;
+   ScoreList& score_list;
+   string player_name;
+};
+
+// keeps the layout size of a screen and letterboxes it inside the window
+void set_scene_view(RenderWindow& window, float width, float height)
+{
+   View view(FloatRect(0, 0, width, height));
+
+   float window_ratio = window.getSize().x / static_cast<float>(window.getSize().y);
+   float view_ratio = width / height;
+
+   if (window_ratio > view_ratio)
+   {
+      view.setViewport(FloatRect(0.5f * (1 - view_ratio / window_ratio), 0, view_ratio / window_ratio, 1));
+   }
+   else
+   {
+      view.setViewport(FloatRect(0, 0.5f * (1 - window_ratio / view_ratio), 1, window_ratio / view_ratio));
+   }
+
+   window.setView(view);
+}
+
+// set by --scale, 0 takes the largest whole factor that fits the window
+unsigned char frame_scale = 0;
+
+// a screen drawn at its native size into one texture, then shown as a single nearest-neighbour quad
+// at a whole multiple of that size, centred with black bars. Sprites are rasterised at native size
+// however large the window is, and resizing the window only moves the quad
+class ScaledFrame
+{
+   RenderTexture texture;
+   Sprite sprite;
+   bool created;
+
+public:
+   ScaledFrame() : created(0) {}
+
+   // a chosen factor that no longer fits drops to the largest one that does, never below 1
+   static unsigned char factor(const Vector2u& window_size, unsigned short width, unsigned short height)
+   {
+      unsigned fits = max(1u, min(window_size.x / width, window_size.y / height));
+
+      return static_cast<unsigned char>(min(0 < frame_scale ? frame_scale : 255u, fits));
+   }
+
+   template <typename Render>
+   void present(RenderWindow& window, unsigned short width, unsigned short height, Render render)
+   {
+      if (!created)
+      {
+         created = texture.create(width, height);
+         texture.setSmooth(0);
+         sprite.setTexture(texture.getTexture(), 1);
+      }
+
+      // no render texture support, scale every draw through the view instead
+      if (!created)
+      {
+         set_scene_view(window, width, height);
+         window.clear();
+         render(window);
+         return;
+      }
+
+      texture.clear();
+      render(texture);
+      texture.display();
+
+      Vector2u size = window.getSize();
+      unsigned char scale = factor(size, width, height);
+
+      // whole pixel offsets keep every texel on the same number of window pixels
+      window.setView(View(FloatRect(0, 0, size.x, size.y)));
+      window.clear();
+      sprite.setScale(scale, scale);
+      sprite.setPosition(static_cast<float>((static_cast<int>(size.x) - width * scale) / 2), static_cast<float>((static_cast<int>(size.y) - height * scale) / 2));
+      window.draw(sprite);
+   }
+};
+
+// lobby creation
+void draw_lobby_text(unsigned short x, unsigned short y, const string& text, RenderWindow& window, bool highlight = false, bool center = false)
+{
+   short character_x = x;
+   short character_y = y;
+
+Sprite sprite;
+   unsigned char character_width = static_cast<unsigned char>(ATLAS_FONT.width / 96);
+
+   sprite.setTexture(get_atlas());
+   
+
+   float scale = highlight ? 2.5f : 2.0f;
+   sprite.setScale(scale, scale);
+
+   // Calculate text width for centering
+   float text_width = 0;
+   for (string::const_iterator it = text.begin(); it != text.end(); ++it)
+   {
+      if (*it == '\n') break;
+      text_width += character_width * scale;
+   }
+
+   
+   if (center)
+   {
+      unsigned short window_width = static_cast<unsigned short>(window.getView().getSize().x);
+      character_x = static_cast<short>((window_width - text_width) / 2);
+   }
+
+   short start_x = character_x;
+
+   for (string::const_iterator it = text.begin(); it != text.end(); ++it)
+   {
+      if ('\n' == *it)
+      {
+        
+         if (center)
+         {
+            
+            size_t offset = 1 + static_cast<size_t>(it - text.begin());
+            size_t next_break = text.find_first_of('\n', offset);
+            size_t len = (next_break == string::npos ? text.size() : next_break) - offset;
+            string next_line = text.substr(offset, len);
+            float next_line_width = next_line.size() * character_width * scale;
+            character_x = static_cast<short>((window.getView().getSize().x - next_line_width) / 2);
+         }
+         else
+         {
+            character_x = start_x;
+         }
+         character_y += FONT_HEIGHT * scale;
+         continue;
+      }
+
+      sprite.setPosition(character_x, character_y);
+      sprite.setTextureRect(atlas_rect(ATLAS_FONT, character_width * (*it - 32), 0, character_width, FONT_HEIGHT));
+
+      character_x += character_width * scale;
+
+      window.draw(sprite);
+   }
+}
+
+
+constexpr unsigned short LOBBY_WIDTH = 800;
+constexpr unsigned short LOBBY_HEIGHT = 700;
+
+class LobbyScene : public MenuScene {
+    SceneContext& context;
+    Sprite bgSprite;
+    bool imageChecked;
+    bool imageLoaded;
+    float shownProgress;
+    Color bgColor;
+
+    unsigned short startButtonWidth;
+    unsigned short startButtonHeight;
+    unsigned short startButtonX;
+    unsigned short startButtonY;
+    unsigned short viewScoreButtonX;
+    unsigned short viewScoreButtonY;
+
+    bool startButtonHovered;
+    bool viewScoreButtonHovered;
+
+public:
+    explicit LobbyScene(SceneContext& in_context) :
+        MenuScene("Lobby"),
+        context(in_context),
+        imageChecked(false),
+        imageLoaded(false),
+        shownProgress(-1),
+        bgColor(25, 25, 112),  // dark blue
+        startButtonWidth(300),
+        startButtonHeight(60),
+        startButtonHovered(false),
+        viewScoreButtonHovered(false)
+    {
+        // buttons centered horizontally, start above and view score below the middle
+        startButtonX = (LOBBY_WIDTH - startButtonWidth) / 2;
+        startButtonY = LOBBY_HEIGHT / 2 - 80;
+        viewScoreButtonX = (LOBBY_WIDTH - startButtonWidth) / 2;
+        viewScoreButtonY = LOBBY_HEIGHT / 2 + 10;
+    }
+
+    void enter() override {
+        MenuScene::enter();
+        context.window.setTitle("Pac-Man Lobby");
+        set_scene_view(context.window, LOBBY_WIDTH, LOBBY_HEIGHT);
+        startButtonHovered = false;
+        viewScoreButtonHovered = false;
+
+        // adding the music
+        context.music.play(LobbyTrack);
+    }
+
+    void exit() override {
+        MenuScene::exit();
+        context.music.stop();  // Stop music when leaving the lobby
+    }
+
+    // the loader is the only thing moving on this screen besides the mouse
+    bool update() override {
+        if (loaderProgress() != shownProgress ||
+            (!imageChecked && (!asset_loader || texture_ready("Resources/Images/Lobby.jpg")))) {
+            redraw();
+        }
+
+        return MenuScene::update();
+    }
+
+    void handle_event(const Event& event) override {
+        // Start button click
+        if (event.type == Event::MouseButtonPressed &&
+            event.mouseButton.button == Mouse::Left) {
+            Vector2f mousePos = context.window.mapPixelToCoords(Vector2i(event.mouseButton.x, event.mouseButton.y));
+
+            if (over(mousePos, startButtonX, startButtonY)) {
+                start();
+            }
+            else if (over(mousePos, viewScoreButtonX, viewScoreButtonY)) {
+                context.scenes.replace(ScoresScreen);
+            }
+        }
+
+        // Press Enter to start, V to view scores
+        else if (event.type == Event::KeyPressed) {
+            if (event.key.code == Keyboard::Enter) {
+                start();
+            }
+            else if (event.key.code == Keyboard::V) {
+                context.scenes.replace(ScoresScreen);
+            }
+        }
+
+        // Hover detection
+        else if (event.type == Event::MouseMoved) {
+            Vector2f mousePos = context.window.mapPixelToCoords(Vector2i(event.mouseMove.x, event.mouseMove.y));
+            bool startHovered = over(mousePos, startButtonX, startButtonY);
+            bool viewScoreHovered = over(mousePos, viewScoreButtonX, viewScoreButtonY);
+
+            if (startHovered != startButtonHovered || viewScoreHovered != viewScoreButtonHovered) {
+                startButtonHovered = startHovered;
+                viewScoreButtonHovered = viewScoreHovered;
+                redraw();
+            }
+        }
+    }
+
+    void draw_menu() override {
+        RenderWindow& lobbyWindow = context.window;
+        lobbyWindow.clear(bgColor);
+
+        // background image, shown as soon as the loader has it
+        if (!imageChecked && (!asset_loader || texture_ready("Resources/Images/Lobby.jpg"))) {
+            const Texture& bgTexture = get_texture("Resources/Images/Lobby.jpg");
+            imageChecked = true;
+            imageLoaded = bgTexture.getSize().x > 0;
+
+            if (imageLoaded) {
+                bgSprite.setTexture(bgTexture);
+                bgSprite.setScale(LOBBY_WIDTH / static_cast<float>(bgTexture.getSize().x),
+                                  LOBBY_HEIGHT / static_cast<float>(bgTexture.getSize().y));
+            }
+        }
+
+        if (imageLoaded) {
+            lobbyWindow.draw(bgSprite);
+        }
+
+        // Title - centered horizontally, near top
+        draw_lobby_text(0, 30, "PAC-MAN", lobbyWindow, true, true);
+
+        // Start Button - centered both horizontally and vertically
+        draw_lobby_text(0, startButtonY, "START GAME", lobbyWindow, startButtonHovered, true);
+
+        // View Score Button - centered both horizontally and vertically
+        draw_lobby_text(0, viewScoreButtonY, "VIEW SCORE", lobbyWindow, viewScoreButtonHovered, true);
+
+        // Instructions - centered horizontally, near bottom
+        draw_lobby_text(0, LOBBY_HEIGHT - 80, "Press START/Enter or VIEW SCORE/V", lobbyWindow, false, true);
+
+        // startup progress while the loader is still busy
+        shownProgress = loaderProgress();
+
+        if (0 <= shownProgress) {
+            RectangleShape frame(Vector2f(LOBBY_WIDTH - 200, 10));
+            frame.setPosition(100, LOBBY_HEIGHT - 30);
+            frame.setFillColor(Color::Transparent);
+            frame.setOutlineColor(Color::White);
+            frame.setOutlineThickness(1);
+            lobbyWindow.draw(frame);
+
+            RectangleShape bar(Vector2f((LOBBY_WIDTH - 200) * shownProgress, 10));
+            bar.setPosition(100, LOBBY_HEIGHT - 30);
+            bar.setFillColor(Color::Yellow);
+            lobbyWindow.draw(bar);
+        }
+    }
+
+private:
+    // -1 once there is no bar to show
+    static float loaderProgress() {
+        return asset_loader && !asset_loader->done() ? asset_loader->progress() : -1;
+    }
+
+    bool over(const Vector2f& mousePos, unsigned short x, unsigned short y) const {
+        return mousePos.x >= x && mousePos.x <= x + startButtonWidth &&
+               mousePos.y >= y && mousePos.y <= y + startButtonHeight;
+    }
+
+    void start() {
+        context.scenes.replace(NameEntryScreen);
+    }
+};
+
+
+void showScoresScreen(Font& font, const std::string& bgImagePath, ScoreNode* head) {
+RenderWindow win(VideoMode(340, 280), "Top Scores - Linked List");
+Texture bgTexture; load_texture(bgTexture, bgImagePath); Sprite bgSprite(bgTexture);
+Text title("TOP 5 SCORES", font, 26); title.setFillColor(Color::Yellow); title.setPosition(60, 10);
+    
+  // displaying the linked list in gui interfrence
+    string listInfo = "Linked List Traversal:";
+Text infoText(listInfo, font, 14); 
+    infoText.setFillColor(Color::Cyan);
+    infoText.setPosition(20, 40);
+    
+    vector<Text> lines;
+    
+   
+    ScoreNode* cur = head;  
+    int node_count = 0;
+    for (int i=0; i<5; ++i) {
+        string row = to_string(i+1) + ". ";
+        if (cur) { 
+            // LINKED LIST: Access current node data
+            row += cur->name + " - " + to_string(cur->score);
+            if (cur->next) {
+                row += " -> next";
+            } else {
+                row += " -> null";
+            }
+            cur = cur->next;  
+            node_count++;
+        }
+        else row += "[empty]";
+        lines.emplace_back(row, font, 18);
+        lines.back().setPosition(30, 65 + i*35);
+    }
+    
+    // Show node count
+    string countText = "Nodes: " + std::to_string(node_count);
+Text countDisplay(countText, font, 16);
+    countDisplay.setFillColor(Color::Green);
+    countDisplay.setPosition(20, 250);
+    while (win.isOpen()) {
+Event e;
+        while (win.pollEvent(e)) {
+            if (e.type == Event::Closed || (e.type == Event::KeyPressed)) win.close();
+        }
+        win.clear(); 
+        win.draw(bgSprite); 
+        win.draw(title);
+        win.draw(infoText);
+        win.draw(countDisplay);
+        for (auto& l : lines) win.draw(l);
+        win.display();
+    }
+}
+
+std::string askName(Font& font, const std::string& bgImagePath) {
+RenderWindow window(VideoMode(350, 100), "Enter Name");
+Texture bgTexture; load_texture(bgTexture, bgImagePath); Sprite bgSprite(bgTexture);
+Text prompt("Enter your name:", font, 20); prompt.setPosition(8, 10);
+    std::string nameStr; Text nameDisplay("", font, 22); nameDisplay.setPosition(8, 44);
+    while (window.isOpen()) {
+Event event;
+        while (window.pollEvent(event)) {
+            if (event.type == Event::Closed) window.close();
+            if (event.type == Event::TextEntered) {
+                if (event.text.unicode == '\b') { if (!nameStr.empty()) nameStr.pop_back();
+                } else if (event.text.unicode == '\r' || event.text.unicode == '\n') {
+                    if (!nameStr.empty()) { window.close(); return nameStr; }
+                } else if (event.text.unicode < 128 && nameStr.size() < 12 && event.text.unicode >= 32)
+                    nameStr += static_cast<char>(event.text.unicode);
+            }
+            if (event.type == Event::KeyPressed && event.key.code == Keyboard::Enter)
+                if (!nameStr.empty()) { window.close(); return nameStr; }
+        }
+        nameDisplay.setString(nameStr + '_');
+        window.clear(); window.draw(bgSprite); window.draw(prompt); window.draw(nameDisplay); window.display();
+    }
+    return "Player";
+}
+
+void playGame(const std::string& playerName, Font& font, const std::string& bgImagePath) {
+RenderWindow win(VideoMode(360, 120), "Playing Game!");
+Texture bgTexture; load_texture(bgTexture, bgImagePath); Sprite bgSprite(bgTexture);
+Text info("Playing as: " + playerName, font, 20); info.setPosition(18, 38);
+    int frame = 0;
+    while (win.isOpen() && frame < 70) {
+Event e; while (win.pollEvent(e)) if (e.type == Event::Closed) win.close();
+        win.clear(); win.draw(bgSprite); win.draw(info); win.display(); ++frame;
+    }
+}
+
+// getiing the name of player here
+string ask_player_name(RenderWindow& window) {
+Font font;
+    font.loadFromFile("Resources/Images/Font.ttf"); 
+Text prompt("Enter your name (max 10 chars):", font, 22);
+    prompt.setFillColor(Color::White);
+    prompt.setPosition(20, 40);
+Text input_text("", font, 22);
+    input_text.setFillColor(Color::Yellow);
+    input_text.setPosition(20, 80);
+    
+    std::string name;
+    bool done = false;
+    while (!done && window.isOpen()) {
+Event event;
+        while (window.pollEvent(event)) {
+            if (event.type == Event::Closed) window.close();
+            if (event.type == Event::TextEntered) {
+                if (event.text.unicode == 8) { // backspace
+                    if (!name.empty()) name.pop_back();
+                } else if (event.text.unicode == 13) { // enter
+                    done = !name.empty();
+                } else if (event.text.unicode < 128 && isalnum(event.text.unicode) && name.size() < 10) {
+                    name += static_cast<char>(event.text.unicode);
+                }
+            }
+        }
+        window.clear(Color::Black);
+        window.draw(prompt);
+        input_text.setString(name + '_');
+        window.draw(input_text);
+        window.display();
+    }
+    return name.empty() ? "Player" : name;
+}
+
+// leaderboard shared by all cabinets, scores.txt stays as the local copy
+constexpr unsigned short LEADERBOARD_PORT = 53000;
+constexpr unsigned char LEADERBOARD_SUBMIT = 1;
+constexpr unsigned char LEADERBOARD_TOP = 2;
+constexpr unsigned char LEADERBOARD_RANK = 3;
+constexpr unsigned char LEADERBOARD_ACK = 4;
+constexpr unsigned int LEADERBOARD_BATCH_SIZE = 32;
+constexpr unsigned int LEADERBOARD_MAX_IN_FLIGHT = 8;
+constexpr unsigned int LEADERBOARD_QUEUE_SIZE = 1024;
+constexpr int LEADERBOARD_FLUSH_MS = 250;
+constexpr int LEADERBOARD_SHUTDOWN_MS = 3000;
+
+// order statistics tree (treap) so top-K and rank queries are O(log n + K)
+// ordered by score descending, older entries first on equal score
+class RankTree {
+    struct Node {
+        std::string name;
+        int score;
+        unsigned long long seq;
+        unsigned priority;
+        unsigned size;
+        Node* left;
+        Node* right;
+        Node(const std::string& n, int s, unsigned long long q, unsigned p)
+            : name(n), score(s), seq(q), priority(p), size(1), left(nullptr), right(nullptr) {}
+    };
+
+    Node* root;
+    unsigned long long next_seq;
+    unsigned rng_state;
+    // best entry per player, used to answer rank-of-player
+    std::map<std::string, std::pair<int, unsigned long long>> best;
+
+    static unsigned size_of(Node* n) { return n ? n->size : 0; }
+    static void fix(Node* n) { n->size = 1 + size_of(n->left) + size_of(n->right); }
+    static bool before(int score_a, unsigned long long seq_a, int score_b, unsigned long long seq_b) {
+        return score_a > score_b || (score_a == score_b && seq_a < seq_b);
+    }
+
+    // own generator so rand() used by the ghosts is left untouched
+    unsigned next_priority() {
+        rng_state ^= rng_state << 13;
+        rng_state ^= rng_state >> 17;
+        rng_state ^= rng_state << 5;
+        return rng_state;
+    }
+
+    static void split(Node* n, int score, unsigned long long seq, Node*& l, Node*& r) {
+        if (!n) { l = r = nullptr; return; }
+        if (before(n->score, n->seq, score, seq)) {
+            split(n->right, score, seq, n->right, r);
+            l = n;
+        } else {
+            split(n->left, score, seq, l, n->left);
+            r = n;
+        }
+        fix(n);
+    }
+
+    static Node* merge(Node* l, Node* r) {
+        if (!l) return r;
+        if (!r) return l;
+        if (l->priority > r->priority) {
+            l->right = merge(l->right, r);
+            fix(l);
+            return l;
+        }
+        r->left = merge(l, r->left);
+        fix(r);
+        return r;
+    }
+
+    static void collect(Node* n, unsigned k, std::vector<std::pair<std::string, int>>& out) {
+        if (!n || out.size() >= k) return;
+        collect(n->left, k, out);
+        if (out.size() < k) out.emplace_back(n->name, n->score);
+        collect(n->right, k, out);
+    }
+
+    static void destroy(Node* n) {
+        if (!n) return;
+        destroy(n->left);
+        destroy(n->right);
+        delete n;
+    }
+
+public:
+    RankTree() : root(nullptr), next_seq(0), rng_state(2463534242u) {}
+    ~RankTree() { destroy(root); }
+    RankTree(const RankTree&) = delete;
+    RankTree& operator=(const RankTree&) = delete;
+
+    void insert(const std::string& name, int score) {
+        unsigned long long seq = next_seq++;
+        Node* l;
+        Node* r;
+        split(root, score, seq, l, r);
+        root = merge(merge(l, new Node(name, score, seq, next_priority())), r);
+
+        auto it = best.find(name);
+        if (it == best.end() || before(score, seq, it->second.first, it->second.second)) {
+            best[name] = {score, seq};
+        }
+    }
+
+    std::vector<std::pair<std::string, int>> top(unsigned k) const {
+        std::vector<std::pair<std::string, int>> out;
+        out.reserve(std::min<size_t>(k, size_of(root)));
+        collect(root, k, out);
+        return out;
+    }
+
+    // 1 based rank of the player's best entry, 0 when the player is unknown
+    unsigned rank_of(const std::string& name, int& score) const {
+        auto it = best.find(name);
+        if (it == best.end()) return 0;
+        score = it->second.first;
+        unsigned ahead = 0;
+        for (Node* n = root; n; ) {
+            if (before(n->score, n->seq, it->second.first, it->second.second)) {
+                ahead += 1 + size_of(n->left);
+                n = n->right;
+            } else {
+                n = n->left;
+            }
+        }
+        return 1 + ahead;
+    }
+
+    unsigned size() const { return size_of(root); }
+};
+
+// server side: aggregates submissions from every cabinet on the network
+class LeaderboardServer {
+    RankTree index;
+    std::string save_path;
+    TcpListener listener;
+    // the next batch id expected from each client, a batch sent again after its ack was lost is not applied twice
+    std::map<Uint64, Uint32> next_batches;
+    std::atomic<bool> serving;
+    // for --verify-leaderboard, the connection is dropped instead of acknowledging this many submits
+    std::atomic<unsigned> dropped_acks;
+
+public:
+    explicit LeaderboardServer(const std::string& path) : save_path(path), serving(true), dropped_acks(0) {
+        ifstream ifs(save_path);
+        string name;
+        int score;
+        while (ifs >> name >> score) index.insert(name, score);
+    }
+
+    int run(unsigned short port) {
+        if (!listen(port)) return 1;
+        serve();
+        return 0;
+    }
+
+    // Socket::AnyPort picks a free port, get_port tells which
+    bool listen(unsigned short port) {
+        if (listener.listen(port) != Socket::Done) {
+            std::cerr << "Leaderboard: cannot listen on port " << port << ".\n";
+            return false;
+        }
+        std::cout << "Leaderboard: listening on port " << listener.getLocalPort() << " with " << index.size() << " scores.\n";
+        return true;
+    }
+
+    unsigned short get_port() const { return listener.getLocalPort(); }
+    void drop_acks(unsigned count) { dropped_acks = count; }
+    // serve returns within a tenth of a second
+    void stop() { serving = false; }
+
+    void serve() {
+        SocketSelector selector;
+        selector.add(listener);
+        vector<unique_ptr<TcpSocket>> clients;
+
+        while (serving) {
+            if (!selector.wait(milliseconds(100))) continue;
+
+            if (selector.isReady(listener)) {
+                unique_ptr<TcpSocket> client(new TcpSocket);
+                if (listener.accept(*client) == Socket::Done) {
+                    selector.add(*client);
+                    clients.push_back(std::move(client));
+                }
+            }
+
+            for (size_t i = 0; i < clients.size(); ) {
+                TcpSocket& client = *clients[i];
+                if (selector.isReady(client)) {
+                    Packet request;
+                    Socket::Status status = client.receive(request);
+                    bool drop = false;
+                    if (status == Socket::Done) {
+                        Packet reply;
+                        if (handle(request, reply, drop) && !drop) client.send(reply);
+                    }
+                    if (drop || status == Socket::Disconnected || status == Socket::Error) {
+                        selector.remove(client);
+                        clients.erase(clients.begin() + i);
+                        continue;
+                    }
+                }
+                ++i;
+            }
+        }
+    }
+
+private:
+    bool handle(Packet& request, Packet& reply, bool& drop) {
+        Uint8 type = 0;
+        Uint32 id = 0;
+        if (!(request >> type >> id)) return false;
+
+        if (type == LEADERBOARD_SUBMIT) {
+            Uint64 client = 0;
+            Uint32 count = 0;
+            request >> client >> count;
+            // batches come in id order, an older id is a resend of one already applied and only gets its ack
+            auto next = next_batches.find(client);
+            Uint32 accepted = 0;
+            if (next == next_batches.end() || id >= next->second) {
+                ofstream ofs(save_path, ios::app);
+                for (Uint32 i = 0; i < count; ++i) {
+                    string name;
+                    Int32 score = 0;
+                    if (!(request >> name >> score)) break;
+                    index.insert(name, score);
+                    ofs << name << ' ' << score << '\n';
+                    ++accepted;
+                }
+                next_batches[client] = id + 1;
+            }
+            reply << Uint8(LEADERBOARD_ACK) << id << accepted;
+            if (dropped_acks > 0) {
+                --dropped_acks;
+                drop = true;
+            }
+            return true;
+        }
+        if (type == LEADERBOARD_TOP) {
+            Uint32 k = 0;
+            request >> k;
+            vector<pair<string, int>> rows = index.top(std::min<Uint32>(k, 1000));
+            reply << Uint8(LEADERBOARD_TOP) << id << Uint32(rows.size());
+            for (auto& row : rows) reply << row.first << Int32(row.second);
+            return true;
+        }
+        if (type == LEADERBOARD_RANK) {
+            string name;
+            request >> name;
+            int score = 0;
+            unsigned rank = index.rank_of(name, score);
+            reply << Uint8(LEADERBOARD_RANK) << id << Uint32(rank) << Int32(score) << Uint32(index.size());
+            return true;
+        }
+        return false;
+    }
+};
+
+// client side: save_score only queues, a worker thread batches and pipelines the sends
+class LeaderboardClient {
+    struct Batch {
+        Uint32 id;
+        vector<pair<string, int>> entries;
+    };
+
+    IpAddress address;
+    unsigned short port;
+    // random per client, the server tells a resent batch from a new one by client and batch id
+    Uint64 client_id;
+    // any thread submits, the worker moves them into pending which only it touches
+    MpscQueue<pair<string, int>, LEADERBOARD_QUEUE_SIZE> submissions;
+    vector<pair<string, int>> pending;
+    deque<Batch> in_flight;
+    Uint32 next_batch;
+    std::atomic<bool> running;
+    Thread worker;
+
+public:
+    LeaderboardClient(const IpAddress& in_address, unsigned short in_port) :
+        address(in_address),
+        port(in_port),
+        client_id(0),
+        next_batch(0),
+        running(true),
+        worker(&LeaderboardClient::run, this)
+    {
+        std::random_device device;
+        client_id = (Uint64(device()) << 32) | device();
+        worker.launch();
+    }
+
+    // unsent scores get LEADERBOARD_SHUTDOWN_MS to reach the server, then they are dropped
+    ~LeaderboardClient() {
+        running = false;
+        worker.wait();
+    }
+
+    void submit(const string& name, int score) {
+        if (!submissions.push({name, score})) {
+            std::cerr << "Leaderboard: submission queue full, the score of " << name << " stays local.\n";
+        }
+    }
+
+    // blocking one-shot queries on a connection of their own, for tools and menus, no client needed
+    static vector<pair<string, int>> query_top(const IpAddress& address, unsigned short port, unsigned k, Time timeout = seconds(2)) {
+        vector<pair<string, int>> rows;
+        Packet request;
+        request << Uint8(LEADERBOARD_TOP) << Uint32(0) << Uint32(k);
+        Packet reply;
+        if (!query(address, port, request, reply, timeout)) return rows;
+        Uint8 type;
+        Uint32 id, count;
+        reply >> type >> id >> count;
+        for (Uint32 i = 0; i < count; ++i) {
+            string name;
+            Int32 score;
+            if (!(reply >> name >> score)) break;
+            rows.emplace_back(name, score);
+        }
+        return rows;
+    }
+
+    static unsigned query_rank(const IpAddress& address, unsigned short port, const string& name, int& score, unsigned& total,
+                               Time timeout = seconds(2)) {
+        Packet request;
+        request << Uint8(LEADERBOARD_RANK) << Uint32(0) << name;
+        Packet reply;
+        if (!query(address, port, request, reply, timeout)) return 0;
+        Uint8 type;
+        Uint32 id, rank, count;
+        Int32 best;
+        if (!(reply >> type >> id >> rank >> best >> count)) return 0;
+        score = best;
+        total = count;
+        return rank;
+    }
+
+private:
+    static bool query(const IpAddress& address, unsigned short port, Packet& request, Packet& reply, Time timeout) {
+        TcpSocket socket;
+        if (socket.connect(address, port, timeout) != Socket::Done) return false;
+        if (socket.send(request) != Socket::Done) return false;
+        SocketSelector selector;
+        selector.add(socket);
+        return selector.wait(timeout) && socket.receive(reply) == Socket::Done;
+    }
+
+    void run() {
+        TcpSocket socket;
+        SocketSelector selector;
+        bool connected = false;
+        Clock flush_clock;
+        Clock shutdown_clock;
+        bool was_stopping = false;
+
+        while (true) {
+            bool stopping = !running;
+            if (stopping && !was_stopping) {
+                was_stopping = true;
+                shutdown_clock.restart();
+            }
+
+            pair<string, int> entry;
+            while (submissions.pop(entry)) pending.push_back(std::move(entry));
+
+            // a server that stops answering must not keep the game from closing
+            if (stopping && shutdown_clock.getElapsedTime().asMilliseconds() >= LEADERBOARD_SHUTDOWN_MS) {
+                give_up();
+                return;
+            }
+
+            if (!connected) {
+                bool idle = pending.empty() && in_flight.empty();
+                if (idle) {
+                    if (stopping) return;
+                    sf::sleep(milliseconds(LEADERBOARD_FLUSH_MS));
+                    continue;
+                }
+                connected = socket.connect(address, port, seconds(1)) == Socket::Done;
+                if (!connected) {
+                    // server down, keep the scores queued and stop retrying on shutdown
+                    if (stopping) {
+                        give_up();
+                        return;
+                    }
+                    sf::sleep(seconds(1));
+                    continue;
+                }
+                selector.clear();
+                selector.add(socket);
+                // anything unacknowledged goes out again on the new connection
+                for (Batch& batch : in_flight) {
+                    if (!send_batch(socket, batch)) { connected = false; break; }
+                }
+                if (!connected) continue;
+            }
+
+            // acks come back in order, each one retires the oldest batch
+            while (selector.wait(milliseconds(20))) {
+                Packet ack;
+                if (socket.receive(ack) != Socket::Done) { connected = false; break; }
+                Uint8 type;
+                Uint32 id;
+                if (ack >> type >> id && type == LEADERBOARD_ACK && !in_flight.empty() && in_flight.front().id == id) {
+                    in_flight.pop_front();
+                }
+            }
+            if (!connected) { socket.disconnect(); continue; }
+
+            Batch batch;
+            bool due = pending.size() >= LEADERBOARD_BATCH_SIZE ||
+                       flush_clock.getElapsedTime().asMilliseconds() >= LEADERBOARD_FLUSH_MS || stopping;
+            if (!pending.empty() && due && in_flight.size() < LEADERBOARD_MAX_IN_FLIGHT) {
+                size_t count = std::min<size_t>(pending.size(), LEADERBOARD_BATCH_SIZE);
+                batch.entries.assign(pending.begin(), pending.begin() + count);
+                pending.erase(pending.begin(), pending.begin() + count);
+            }
+            if (stopping && pending.empty() && in_flight.empty() && batch.entries.empty()) return;
+            if (!batch.entries.empty()) {
+                flush_clock.restart();
+                batch.id = next_batch++;
+                in_flight.push_back(batch);
+                if (!send_batch(socket, in_flight.back())) {
+                    connected = false;
+                    socket.disconnect();
+                }
+            }
+        }
+    }
+
+    void give_up() const {
+        size_t lost = pending.size();
+        for (const Batch& batch : in_flight) lost += batch.entries.size();
+        if (lost) std::cerr << "Leaderboard: server unreachable, " << lost << " scores were not submitted, they stay in scores.txt.\n";
+    }
+
+    bool send_batch(TcpSocket& socket, const Batch& batch) const {
+        Packet packet;
+        packet << Uint8(LEADERBOARD_SUBMIT) << batch.id << client_id << Uint32(batch.entries.size());
+        for (const auto& entry : batch.entries) packet << entry.first << Int32(entry.second);
+        return socket.send(packet) == Socket::Done;
+    }
+};
+
+// set from the command line, scores stay local when there is no server
+LeaderboardClient* leaderboard_client = nullptr;
+
+// splits "host[:port]"
+void parse_leaderboard_address(const string& text, IpAddress& address, unsigned short& port) {
+    size_t colon = text.find(':');
+    address = IpAddress(text.substr(0, colon));
+    port = LEADERBOARD_PORT;
+    if (colon != string::npos) port = static_cast<unsigned short>(atoi(text.c_str() + colon + 1));
+}
+
+// Saving score to file named the  scores.txxt
+void save_score(const string& name, int score) {
+    ofstream ofs("scores.txt", ios::app);
+    if (ofs.is_open()) {
+        ofs << name << ' ' << score << '\n';
+        ofs.close();
+    }
+    if (leaderboard_client) leaderboard_client->submit(name, score);
+}
+
+// get the scores for scores.txt
+void load_scores_from_file(ScoreList& score_list) {
+    ifstream ifs("scores.txt");
+    if (ifs.is_open()) {
+        string name;
+        int score;
+        while (ifs >> name >> score) {
+            score_list.add(name, score);
+        }
+        ifs.close();
+    }
+}
+
+// Read top 5 scores from file
+vector<pair<string, int>> get_top_scores() { // just read the top 5 highest scores
+    vector<pair<string, int>> scores;
+    ifstream ifs("scores.txt");
+    string name;
+    int score;
+    while (ifs >> name >> score) {
+        scores.emplace_back(name, score);
+    }
+    std::sort(scores.begin(), scores.end(), [](auto &a, auto &b) { return a.second > b.second; });
+    if (scores.size() > 5) scores.resize(5);
+    return scores;
+}
+
+
+constexpr unsigned short SCORES_WIDTH = 600;
+constexpr unsigned short SCORES_HEIGHT = 500;
+
+class ScoresScene : public MenuScene {
+    SceneContext& context;
+    Sprite bgSprite;
+    bool imageLoaded;
+    Color bgColor;
+
+public:
+    explicit ScoresScene(SceneContext& in_context) :
+        MenuScene("Scores"),
+        context(in_context),
+        imageLoaded(false),
+        bgColor(25, 25, 112)
+    {
+    }
+
+    void enter() override {
+        MenuScene::enter();
+        context.window.setTitle("Top 5 Scores");
+        set_scene_view(context.window, SCORES_WIDTH, SCORES_HEIGHT);
+
+        const Texture& bgTexture = get_texture("Resources/Images/ViewScore.png");
+        imageLoaded = bgTexture.getSize().x > 0;
+
+        if (imageLoaded) {
+            bgSprite.setTexture(bgTexture);
+            bgSprite.setScale(SCORES_WIDTH / static_cast<float>(bgTexture.getSize().x),
+                              SCORES_HEIGHT / static_cast<float>(bgTexture.getSize().y));
+        }
+    }
+
+    void handle_event(const Event& event) override {
+        if (event.type == Event::KeyPressed && event.key.code == Keyboard::Escape) {
+            context.scenes.replace(LobbyScreen);
+        }
+    }
+
+    void draw_menu() override {
+        RenderWindow& viewWindow = context.window;
+        viewWindow.clear(bgColor);
+        
+        // Draw background image if loaded
+        if (imageLoaded) {
+            viewWindow.draw(bgSprite);
+        }
+        
+        
+        draw_lobby_text(0, 50, "TOP 5 SCORES", viewWindow, true, true);
+        
+        ScoreNode* cur = context.score_list.getHead();
+        for (int i = 0; i < 5; ++i) {
+            string row = to_string(i + 1) + ". ";
+            
+            if (cur) {
+                row += cur->name + " - " + to_string(cur->score);
+                cur = cur->next;
+            } else {
+                row += "[No score yet]";
+            }
+            
+            draw_lobby_text(0, 150 + i * 50, row, viewWindow, false, true);
+        }
+        
+        draw_lobby_text(0, SCORES_HEIGHT - 50, "Press ESC to close", viewWindow, false, true);
+    }
+};
+
+// Ask for player name using bitmap font
+constexpr unsigned short NAME_ENTRY_WIDTH = 500;
+constexpr unsigned short NAME_ENTRY_HEIGHT = 200;
+
+class NameEntryScene : public MenuScene {
+    SceneContext& context;
+    Color bgColor;
+    std::string name;
+
+public:
+    explicit NameEntryScene(SceneContext& in_context) : MenuScene("Name entry"), context(in_context), bgColor(0, 0, 0) {}
+
+    void enter() override {
+        MenuScene::enter();
+        context.window.setTitle("Enter Your Name");
+        set_scene_view(context.window, NAME_ENTRY_WIDTH, NAME_ENTRY_HEIGHT);
+        name = "";
+    }
+
+    void handle_event(const Event& event) override {
+        if (event.type == Event::TextEntered) {
+            redraw();
+
+            if (event.text.unicode == 8) { // Backspace
+                if (!name.empty()) name.pop_back();
+            } else if (event.text.unicode == 13 || event.text.unicode == 10) { // Enter
+                if (!name.empty()) {
+                    context.player_name = name;
+                    context.scenes.replace(GameScreen);
+                }
+            } else if (event.text.unicode >= 32 && event.text.unicode < 128 && name.size() < 15) {
+                name += static_cast<char>(event.text.unicode);
+            }
+        }
+    }
+
+    void draw_menu() override {
+        RenderWindow& nameWindow = context.window;
+        nameWindow.clear(bgColor);
+        
+        draw_lobby_text(0, 30, "Enter your name:", nameWindow, false, true);
+        draw_lobby_text(0, 100, name + "_", nameWindow, false, true);
+        draw_lobby_text(0, NAME_ENTRY_HEIGHT - 40, "Press Enter when done", nameWindow, false, true);
+    }
+};
+
+const array<string, MAP_HEIGHT> MAP_SKETCH = {
+   " ################### ",
+   " #........#........# ",
+   " #o##.###.#.###.##o# ",
+   " #.................# ",
+   " #.##.#.#####.#.##.# ",
+   " #....#...#...#....# ",
+   " ####.### # ###.#### ",
+   "    #.#   0   #.#    ",
+   "#####.# ##=## #.#####",
+   "     .  #123#  .   ",
+   "#####.# ##### #.#####",
+   "    #.#       #.#    ",
+   " ####.# ##### #.#### ",
+   " #........#........# ",
+   " #.##.###.#.###.##.# ",
+   " #o.#.....P.....#.o# ",
+   " ##.#.#.#####.#.#.## ",
+   " #....#...#...#....# ",
+   " #.######.#.######.# ",
+   " #.................# ",
+   " ################### "
+};
+
+// player input, window events are stamped as the loop drains them and latched once per tick
+enum InputAction
+{
+   InputRight,
+   InputUp,
+   InputLeft,
+   InputDown,
+   InputConfirm,
+   InputPause
+};
+
+constexpr unsigned char INPUT_ACTION_COUNT = 6;
+constexpr unsigned char INPUT_QUEUE_SIZE = 64;
+// a turn pressed before a corner waits this many ticks for the wall to open
+constexpr unsigned char INPUT_TURN_BUFFER_TICKS = 15;
+// how far a stick or hat has to be pushed to count as a direction
+constexpr float INPUT_AXIS_THRESHOLD = 50;
+constexpr unsigned char INPUT_CONFIRM_BUTTON = 0;
+constexpr unsigned char INPUT_PAUSE_BUTTON = 7;
+
+struct InputEvent
+{
+   unsigned char action;
+   bool pressed;
+   chrono::steady_clock::time_point time;
+};
+
+class InputQueue
+{
+   SimpleQueue<InputEvent, INPUT_QUEUE_SIZE> events;
+   // -1, 0 or 1 for every axis, a stick only raises events when it crosses the threshold
+   array<signed char, Joystick::AxisCount> axes;
+
+   void push(unsigned char action, bool pressed, chrono::steady_clock::time_point time);
+
+public:
+   InputQueue();
+
+   // keys and buttons, sticks go through push since they need the axis state
+   static bool action_of(const Event& event, unsigned char& action, bool& pressed);
+
+   void clear();
+   void push(const Event& event);
+   bool pop(InputEvent& event);
+};
+
+InputQueue::InputQueue()
+{
+   axes.fill(0);
+}
+
+bool InputQueue::action_of(const Event& event, unsigned char& action, bool& pressed)
+{
+   if (Event::KeyPressed == event.type || Event::KeyReleased == event.type)
+   {
+      pressed = Event::KeyPressed == event.type;
+
+      switch (event.key.code)
+      {
+         case Keyboard::Right: action = InputRight; return 1;
+         case Keyboard::Up: action = InputUp; return 1;
+         case Keyboard::Left: action = InputLeft; return 1;
+         case Keyboard::Down: action = InputDown; return 1;
+         case Keyboard::Enter: action = InputConfirm; return 1;
+         case Keyboard::P: action = InputPause; return 1;
+         default: return 0;
+      }
+   }
+   else if (Event::JoystickButtonPressed == event.type || Event::JoystickButtonReleased == event.type)
+   {
+      pressed = Event::JoystickButtonPressed == event.type;
+
+      switch (event.joystickButton.button)
+      {
+         case INPUT_CONFIRM_BUTTON: action = InputConfirm; return 1;
+         case INPUT_PAUSE_BUTTON: action = InputPause; return 1;
+         default: return 0;
+      }
+   }
+
+   return 0;
+}
+
+void InputQueue::clear()
+{
+   events = SimpleQueue<InputEvent, INPUT_QUEUE_SIZE>();
+   axes.fill(0);
+}
+
+// drops the event when full, the latch catches up on the next tick anyway
+void InputQueue::push(unsigned char action, bool pressed, chrono::steady_clock::time_point time)
+{
+   events.push({action, pressed, time});
+}
+
+void InputQueue::push(const Event& event)
+{
+   chrono::steady_clock::time_point now = chrono::steady_clock::now();
+   unsigned char action;
+   bool pressed;
+
+   if (action_of(event, action, pressed))
+   {
+      push(action, pressed, now);
+   }
+   else if (Event::JoystickMoved == event.type)
+   {
+      Joystick::Axis axis = event.joystickMove.axis;
+      bool horizontal = Joystick::X == axis || Joystick::PovX == axis;
+
+      if (!horizontal && Joystick::Y != axis && Joystick::PovY != axis)
+      {
+         return;
+      }
+
+      // both sticks point down and right for positive values
+      signed char side = INPUT_AXIS_THRESHOLD < event.joystickMove.position ? 1 : (-INPUT_AXIS_THRESHOLD > event.joystickMove.position ? -1 : 0);
+
+      if (side != axes[axis])
+      {
+         if (axes[axis])
+         {
+            push(horizontal ? (0 < axes[axis] ? InputRight : InputLeft) : (0 < axes[axis] ? InputDown : InputUp), 0, now);
+         }
+
+         if (side)
+         {
+            push(horizontal ? (0 < side ? InputRight : InputLeft) : (0 < side ? InputDown : InputUp), 1, now);
+         }
+
+         axes[axis] = side;
+      }
+   }
+   else if (Event::LostFocus == event.type)
+   {
+      // releases never arrive without focus, so nothing stays held
+      for (unsigned char a = 0; a < INPUT_ACTION_COUNT; a++)
+      {
+         push(a, 0, now);
+      }
+
+      axes.fill(0);
+   }
+}
+
+bool InputQueue::pop(InputEvent& event)
+{
+   return 1 == events.pop(&event, 1);
+}
+
+// what the simulation sees during one tick, a tap between two ticks still counts as pressed
+class InputLatch
+{
+   unsigned char held;
+   unsigned char pressed;
+   // buffered direction, 4 for none
+   unsigned char turn;
+   unsigned char turn_age;
+   // presses with the tick that latched them, waiting for a frame of that tick, then their latency in milliseconds
+   vector<pair<unsigned long, chrono::steady_clock::time_point>> waiting;
+   vector<float> latencies;
+
+public:
+   InputLatch();
+
+   unsigned char get_held_directions() const { return held & 15; }
+   unsigned char get_turn() const { return turn; }
+   bool is_held(InputAction action) const { return held >> action & 1; }
+   bool was_pressed(InputAction action) const { return pressed >> action & 1; }
+
+   void latch(InputQueue& queue, unsigned long tick);
+   // a frame drawn from this tick reached display() at that time
+   void presented(unsigned long tick, chrono::steady_clock::time_point time);
+   void report() const;
+   void reset();
+   // the buffered turn is dropped once Pac-Man faces that way
+   void turn_taken(unsigned char direction);
+};
+
+InputLatch::InputLatch() :
+   held(0),
+   pressed(0),
+   turn(4),
+   turn_age(0)
+{
+}
+
+void InputLatch::latch(InputQueue& queue, unsigned long tick)
+{
+   pressed = 0;
+
+   if (4 > turn && INPUT_TURN_BUFFER_TICKS <= ++turn_age && !(held >> turn & 1))
+   {
+      turn = 4;
+   }
+
+   InputEvent event;
+   while (queue.pop(event))
+   {
+      unsigned char bit = 1 << event.action;
+
+      if (!event.pressed)
+      {
+         held &= ~bit;
+      }
+      // key repeat sends more presses while held, only the first one counts
+      else if (!(held & bit))
+      {
+         held |= bit;
+         pressed |= bit;
+         waiting.push_back({tick, event.time});
+
+         if (4 > event.action)
+         {
+            turn = event.action;
+            turn_age = 0;
+         }
+      }
+   }
+}
+
+void InputLatch::presented(unsigned long tick, chrono::steady_clock::time_point time)
+{
+   size_t kept = 0;
+
+   for (const pair<unsigned long, chrono::steady_clock::time_point>& press : waiting)
+   {
+      if (press.first <= tick)
+      {
+         latencies.push_back(chrono::duration_cast<chrono::microseconds>(time - press.second).count() / 1000.f);
+      }
+      else
+      {
+         waiting[kept++] = press;
+      }
+   }
+
+   waiting.resize(kept);
+}
+
+void InputLatch::report() const
+{
+   if (latencies.empty())
+   {
+      return;
+   }
+
+   vector<float> sorted = latencies;
+   sort(sorted.begin(), sorted.end());
+
+   float total = 0;
+   for (float latency : sorted)
+   {
+      total += latency;
+   }
+
+   std::cout << "Input: " << sorted.size() << " presses, on screen after " << total / sorted.size() << " ms on average, "
+             << sorted[sorted.size() * 95 / 100] << " ms at p95, " << sorted.back() << " ms at worst.\n";
+}
+
+void InputLatch::reset()
+{
+   held = 0;
+   pressed = 0;
+   turn = 4;
+   turn_age = 0;
+   waiting.clear();
+   latencies.clear();
+}
+
+void InputLatch::turn_taken(unsigned char direction)
+{
+   if (direction == turn)
+   {
+      turn = 4;
+   }
+}
+
+// one writer and one reader pass whole values without locks or waiting. The reader always
+// takes the newest finished value and values it never got to are dropped
+template<typename T>
+class TripleBuffer
+{
+   static constexpr unsigned char FRESH = 4;
+
+   array<T, 3> slots;
+   // the slot between the two sides, with FRESH set until the reader takes it
+   std::atomic<unsigned char> middle;
+   unsigned char back;
+   unsigned char front;
+
+public:
+   TripleBuffer() : middle(1), back(0), front(2) {}
+
+   // the writer fills this slot completely, then publishes it
+   T& write() { return slots[back]; }
+   void publish() { back = middle.exchange(back | FRESH) & 3; }
+
+   // swaps in the newest published value, 0 when nothing new came since the last read
+   bool read()
+   {
+      if (!(middle.load() & FRESH))
+      {
+         return 0;
+      }
+
+      front = middle.exchange(front) & 3;
+      return 1;
+   }
+
+   const T& get() const { return slots[front]; }
+};
+
+constexpr unsigned char FRAME_REPORT_QUEUE_SIZE = 64;
+
+struct FrameReport
+{
+   unsigned long tick;
+   chrono::steady_clock::time_point time;
+};
+
+// what the simulation reads from the controls in one tick, and all a replay has to record
+struct TickInput
+{
+   // buffered direction, 4 for none
+   unsigned char turn;
+   // a bit per direction key still down
+   unsigned char held;
+   bool confirm;
+};
+
+// what a tick did that the screen around the game has to answer
+enum TickEvent
+{
+   TickNothing,
+   TickDied,
+   TickRespawned,
+   TickGameOver
+};
+
+// the game itself without windows, music or clocks. A tick only reads its TickInput and does
+// integer math, ghosts turn with their own seeded generator, so the same seed and inputs give
+// the same hash every tick on every build
+class GameSimulation
+{
+   bool game_won;
+   bool was_dead;
+   unsigned char level;
+   unsigned char lives;
+   int score;
+   unsigned long ticks;
+   // bumped on a new maze and on every pellet eaten, the cached layers redraw when they change
+   unsigned maze_version;
+   unsigned map_version;
+
+   array<array<Cell, MAP_HEIGHT>, MAP_WIDTH> map;
+   WallBitboard wall_bits;
+   JunctionTable junctions;
+   FlowField chase_field;
+   array<Position, 4> ghost_positions;
+   GhostManager ghost_manager;
+   Pacman pacman;
+   LevelTable levels;
+
+   void reset_map();
+
+public:
+   GameSimulation();
+
+   bool get_game_won() const { return game_won; }
+   unsigned char get_level() const { return level; }
+   unsigned char get_lives() const { return lives; }
+   int get_score() const { return score; }
+   unsigned long get_tick() const { return ticks; }
+   unsigned get_maze_version() const { return maze_version; }
+   unsigned get_map_version() const { return map_version; }
+   const array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& get_map() const { return map; }
+   const GhostManager& get_ghosts() const { return ghost_manager; }
+   const Pacman& get_pacman() const { return pacman; }
+   const LevelSettings& get_settings() const { return levels.get(level); }
+
+   Uint64 hash() const;
+   void start(Uint32 seed, const LevelTable& in_levels);
+   TickEvent step(const TickInput& input, AudioEventQueue& audio_events);
+};
+
+GameSimulation::GameSimulation() :
+   game_won(0),
+   was_dead(0),
+   level(0),
+   lives(3),
+   score(0),
+   ticks(0),
+   maze_version(0),
+   map_version(0),
+   map{}
+{
+}
+
+Uint64 GameSimulation::hash() const
+{
+   StateHash state;
+   state.add(game_won);
+   state.add(was_dead);
+   state.add(level);
+   state.add(lives);
+   state.add(static_cast<Int32>(score));
+   state.add(static_cast<Uint32>(ticks));
+
+   for (const array<Cell, MAP_HEIGHT>& column : map)
+   {
+      for (Cell cell : column)
+      {
+         state.add(static_cast<Uint8>(cell));
+      }
+   }
+
+   pacman.hash(state);
+   ghost_manager.hash(state);
+   return state.get();
+}
+
+void GameSimulation::reset_map()
+{
+   map = convert_sketch(MAP_SKETCH, ghost_positions, pacman);
+   wall_bits.build(map);
+   junctions.build(map);
+   chase_field.build(map);
+   ghost_manager.reset(levels.get(level), ghost_positions);
+   pacman.reset();
+
+   maze_version++;
+   map_version++;
+}
+
+void GameSimulation::start(Uint32 seed, const LevelTable& in_levels)
+{
+   game_won = 0;
+   was_dead = 0;
+   level = 0;
+   lives = 3;
+   score = 0;
+   ticks = 0;
+   levels = in_levels;
+
+   ghost_manager.seed(seed);
+   reset_map();
+}
+
+TickEvent GameSimulation::step(const TickInput& input, AudioEventQueue& audio_events)
+{
+   TickEvent event = TickNothing;
+
+   ticks++;
+   pacman.begin_tick();
+   ghost_manager.begin_tick();
+
+   if (pacman.get_dead() && !was_dead)
+   {
+      event = TickDied;
+      was_dead = 1;
+   }
+
+   if (pacman.get_dead() && pacman.get_animation_over())
+   {
+      if (was_dead && lives > 0)
+      {
+         lives--;
+         was_dead = 0;  //reset the flag
+      }
+
+      if (lives > 0)
+      {
+         reset_map();
+         event = TickRespawned;
+      }
+   }
+   else if (!pacman.get_dead())
+   {
+      was_dead = 0;
+   }
+
+   if (!game_won && !pacman.get_dead())
+   {
+      game_won = 1;
+
+      // pellets are the only thing that scores here
+      int previous_score = score;
+      pacman.update(levels.get(level), map, wall_bits, input.turn, input.held, score, audio_events);
+      if (previous_score != score)
+      {
+         map_version++;
+      }
+
+      chase_field.set_target(pacman.get_position());
+      ghost_manager.update(wall_bits, &junctions, &chase_field, pacman);
+
+      for (const array<Cell, MAP_HEIGHT>& column : map)
+      {
+         for (const Cell& cell : column)
+         {
+            if (Cell::Pellet == cell)
+            {
+               game_won = 0;
+               break;
+            }
+         }
+
+         if (!game_won)
+         {
+            break;
+         }
+      }
+
+      if (game_won)
+      {
+         pacman.set_animation_timer(0);
+      }
+   }
+   else if (input.confirm)
+   {
+      if (pacman.get_dead() && pacman.get_animation_over())
+      {
+         if (lives == 0)
+         {
+            event = TickGameOver;
+         }
+      }
+      else if (game_won)
+      {
+         // if all pellets eat then next level will come
+         game_won = 0;
+         score += levels.get(level).level_bonus;  // the bonus for the level just cleared
+         level++;
+
+         reset_map();
+      }
+   }
+
+   // ghosts only move their feet while they are shown
+   if (!game_won && !pacman.get_dead())
+   {
+      ghost_manager.animate();
+   }
+
+   pacman.animate(game_won);
+
+   return event;
+}
+
+// what SoftwareRenderer writes per pixel, an index into its palette or three bytes of red, green and blue
+enum PixelFormat
+{
+   PixelIndex,
+   PixelRgb
+};
+
+// draws a game straight from the simulation into memory, no window or OpenGL involved, for machines
+// without a display or GPU. The sheets are stitched like the atlas, and every sprite is turned into
+// CELL_SIZE x CELL_SIZE palette indices the first time it is drawn with a tint. Index 0 is both the black
+// background and a see-through pixel, so a blit is a masked copy, one SSE2 register per row. The maze and
+// pellets are kept as a background that is only drawn again when they change. The HUD and messages are left out
+class SoftwareRenderer
+{
+   Image atlas;
+   bool background_ready;
+   bool vector_blits;
+   unsigned drawn_maze_version;
+   unsigned drawn_map_version;
+   // indices never change once given out, sprites seen later only append
+   vector<Color> palette;
+   // where each sprite starts in tiles, by atlas position and tint
+   std::map<Uint64, unsigned> tile_offsets;
+   vector<Uint8> tiles;
+   vector<Uint8> background;
+   vector<Uint8> frame;
+   SpriteBatch actors;
+
+   void blit(vector<Uint8>& target, int x, int y, const Uint8* tile) const;
+   Uint8 palette_index(const Color& color);
+   unsigned tile(const IntRect& rect, const Color& color);
+
+public:
+   SoftwareRenderer();
+
+   const vector<Color>& get_palette() const { return palette; }
+
+   // bytes render writes for a format, downsample keeps every n-th pixel of indices and averages n x n for colors
+   static unsigned output_size(PixelFormat format, unsigned char downsample);
+
+   // the next frame draws the background again, for a new simulation whose versions start over
+   void invalidate() { background_ready = 0; }
+   void render(const GameSimulation& simulation, Uint8* pixels, PixelFormat format, unsigned char downsample = 1);
+   void set_vector_blits(bool value) { vector_blits = value; }
+};
+
+SoftwareRenderer::SoftwareRenderer() :
+   atlas(stitch_atlas()),
+   background_ready(0),
+   vector_blits(1),
+   drawn_maze_version(0),
+   drawn_map_version(0),
+   palette(1, Color::Black),
+   background(CELL_SIZE * MAP_WIDTH * CELL_SIZE * MAP_HEIGHT),
+   frame(CELL_SIZE * MAP_WIDTH * CELL_SIZE * MAP_HEIGHT)
+{
+}
+
+unsigned SoftwareRenderer::output_size(PixelFormat format, unsigned char downsample)
+{
+   downsample = max<unsigned char>(1, downsample);
+
+   return (CELL_SIZE * MAP_WIDTH / downsample) * (CELL_SIZE * MAP_HEIGHT / downsample) * (PixelRgb == format ? 3 : 1);
+}
+
+void SoftwareRenderer::blit(vector<Uint8>& target, int x, int y, const Uint8* tile) const
+{
+   const int width = CELL_SIZE * MAP_WIDTH;
+   const int height = CELL_SIZE * MAP_HEIGHT;
+
+#ifdef TILE_BLIT_SSE2
+   // only actors in the tunnel hang over the edge, they take the clipped path below
+   if (vector_blits && 16 == CELL_SIZE && 0 <= x && 0 <= y && x + CELL_SIZE <= width && y + CELL_SIZE <= height)
+   {
+      const __m128i zero = _mm_setzero_si128();
+
+      for (unsigned char b = 0; b < CELL_SIZE; b++)
+      {
+         __m128i source = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tile + CELL_SIZE * b));
+         __m128i* row = reinterpret_cast<__m128i*>(&target[width * (y + b) + x]);
+         __m128i keep = _mm_cmpeq_epi8(source, zero);
+
+         // see-through source pixels are 0, so the kept ones are simply or-ed in
+         _mm_storeu_si128(row, _mm_or_si128(source, _mm_and_si128(keep, _mm_loadu_si128(row))));
+      }
+
+      return;
+   }
+#endif
+
+   for (unsigned char b = 0; b < CELL_SIZE; b++)
+   {
+      if (y + b < 0 || height <= y + b)
+      {
+         continue;
+      }
+
+      for (unsigned char a = 0; a < CELL_SIZE; a++)
+      {
+         Uint8 index = tile[CELL_SIZE * b + a];
+
+         if (0 != index && 0 <= x + a && x + a < width)
+         {
+            target[width * (y + b) + x + a] = index;
+         }
+      }
+   }
+}
+
+Uint8 SoftwareRenderer::palette_index(const Color& color)
+{
+   for (unsigned short a = 1; a < palette.size(); a++)
+   {
+      if (palette[a].r == color.r && palette[a].g == color.g && palette[a].b == color.b)
+      {
+         return static_cast<Uint8>(a);
+      }
+   }
+
+   if (palette.size() < 256)
+   {
+      palette.push_back(Color(color.r, color.g, color.b));
+      return static_cast<Uint8>(palette.size() - 1);
+   }
+
+   // a full palette takes the closest color it has
+   unsigned short closest = 1;
+   int closest_distance = INT_MAX;
+
+   for (unsigned short a = 1; a < palette.size(); a++)
+   {
+      int r = palette[a].r - color.r;
+      int g = palette[a].g - color.g;
+      int b = palette[a].b - color.b;
+
+      if (r * r + g * g + b * b < closest_distance)
+      {
+         closest = a;
+         closest_distance = r * r + g * g + b * b;
+      }
+   }
+
+   return static_cast<Uint8>(closest);
+}
+
+unsigned SoftwareRenderer::tile(const IntRect& rect, const Color& color)
+{
+   Uint64 key = static_cast<Uint64>(rect.left) | static_cast<Uint64>(rect.top) << 16 | static_cast<Uint64>(color.toInteger()) << 32;
+   std::map<Uint64, unsigned>::iterator it = tile_offsets.find(key);
+
+   if (tile_offsets.end() != it)
+   {
+      return it->second;
+   }
+
+   unsigned offset = static_cast<unsigned>(tiles.size());
+   tiles.resize(offset + CELL_SIZE * CELL_SIZE);
+
+   for (unsigned char b = 0; b < CELL_SIZE; b++)
+   {
+      for (unsigned char a = 0; a < CELL_SIZE; a++)
+      {
+         Color texel = atlas.getPixel(rect.left + a, rect.top + b);
+
+         // the same modulation a tinted quad gets on the GPU, the sheets only have clear and solid pixels
+         Color tinted(texel.r * color.r / 255, texel.g * color.g / 255, texel.b * color.b / 255, texel.a * color.a / 255);
+
+         tiles[offset + CELL_SIZE * b + a] = 128 <= tinted.a ? palette_index(tinted) : 0;
+      }
+   }
+
+   tile_offsets[key] = offset;
+   return offset;
+}
+
+void SoftwareRenderer::render(const GameSimulation& simulation, Uint8* pixels, PixelFormat format, unsigned char downsample)
+{
+   const unsigned short width = CELL_SIZE * MAP_WIDTH;
+   const unsigned short height = CELL_SIZE * MAP_HEIGHT;
+   const Pacman& pacman = simulation.get_pacman();
+   bool game_won = simulation.get_game_won();
+   bool maze_shown = !game_won && !pacman.get_dead();
+
+   // the same layers GameScene draws, without the HUD and the messages
+   if (maze_shown)
+   {
+      if (!background_ready || drawn_maze_version != simulation.get_maze_version() || drawn_map_version != simulation.get_map_version())
+      {
+         background_ready = 1;
+         drawn_maze_version = simulation.get_maze_version();
+         drawn_map_version = simulation.get_map_version();
+         fill(background.begin(), background.end(), 0);
+
+         for (unsigned char a = 0; a < MAP_WIDTH; a++)
+         {
+            for (unsigned char b = 0; b < MAP_HEIGHT; b++)
+            {
+               IntRect rect = map_cell_rect(simulation.get_map(), a, b);
+
+               if (0 < rect.width)
+               {
+                  unsigned offset = tile(rect, Color::White);
+                  blit(background, CELL_SIZE * a, CELL_SIZE * b, &tiles[offset]);
+               }
+            }
+         }
+      }
+
+      frame = background;
+   }
+   else
+   {
+      bool game_over = pacman.get_animation_over() && 0 == simulation.get_lives();
+      fill(frame.begin(), frame.end(), game_over ? palette_index(Color(135, 206, 250)) : 0);
+   }
+
+   // the actors fill a batch like on screen, at their tick positions, and its quads are blitted
+   actors.clear();
+   if (maze_shown)
+   {
+      simulation.get_ghosts().draw(simulation.get_settings().flash_start >= pacman.get_energizer_timer(), 1, actors);
+   }
+   pacman.draw(game_won, 1, actors);
+
+   const VertexArray& quads = actors.get_vertices();
+
+   for (size_t a = 0; a < quads.getVertexCount(); a += 4)
+   {
+      const Vertex& corner = quads[a];
+      unsigned offset = tile(IntRect(static_cast<int>(corner.texCoords.x), static_cast<int>(corner.texCoords.y), CELL_SIZE, CELL_SIZE), corner.color);
+
+      blit(frame, static_cast<int>(floor(corner.position.x)), static_cast<int>(floor(corner.position.y)), &tiles[offset]);
+   }
+
+   downsample = max<unsigned char>(1, downsample);
+
+   unsigned short output_width = width / downsample;
+   unsigned short output_height = height / downsample;
+
+   if (PixelIndex == format)
+   {
+      if (1 == downsample)
+      {
+         copy(frame.begin(), frame.end(), pixels);
+         return;
+      }
+
+      for (unsigned short y = 0; y < output_height; y++)
+      {
+         for (unsigned short x = 0; x < output_width; x++)
+         {
+            *pixels++ = frame[width * downsample * y + downsample * x];
+         }
+      }
+
+      return;
+   }
+
+   if (1 == downsample)
+   {
+      for (Uint8 index : frame)
+      {
+         const Color& color = palette[index];
+         *pixels++ = color.r;
+         *pixels++ = color.g;
+         *pixels++ = color.b;
+      }
+
+      return;
+   }
+
+   unsigned area = downsample * downsample;
+
+   for (unsigned short y = 0; y < output_height; y++)
+   {
+      for (unsigned short x = 0; x < output_width; x++)
+      {
+         unsigned r = 0;
+         unsigned g = 0;
+         unsigned b = 0;
+
+         for (unsigned char c = 0; c < downsample; c++)
+         {
+            const Uint8* source = &frame[width * (downsample * y + c) + downsample * x];
+
+            for (unsigned char d = 0; d < downsample; d++)
+            {
+               const Color& color = palette[source[d]];
+               r += color.r;
+               g += color.g;
+               b += color.b;
+            }
+         }
+
+         *pixels++ = static_cast<Uint8>(r / area);
+         *pixels++ = static_cast<Uint8>(g / area);
+         *pixels++ = static_cast<Uint8>(b / area);
+      }
+   }
+}
+
+// replays are text, a "replay <seed>" line and then "<turn> <held> <confirm> <hash>" per tick
+const string REPLAY_HEADER = "replay";
+
+// set by --record, the game played last is written there
+string record_path;
+
+string hash_text(Uint64 hash)
+{
+   char hex[17];
+   snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+   return hex;
+}
+
+void write_replay_tick(ostream& out, const TickInput& input, Uint64 hash)
+{
+   out << static_cast<unsigned>(input.turn) << ' ' << static_cast<unsigned>(input.held) << ' ' << input.confirm << ' ' << hash_text(hash) << '\n';
+}
+
+// everything the renderer needs from one tick, the renderer never touches the live game
+struct GameSnapshot
+{
+   unsigned long tick = 0;
+   // when the tick was due, frames drawn later blend the actors forward from it
+   chrono::steady_clock::time_point time;
+   // bumped on a new maze and on every pellet eaten, the cached layers redraw when they change
+   unsigned maze_version = 0;
+   unsigned map_version = 0;
+   array<array<Cell, MAP_HEIGHT>, MAP_WIDTH> map{};
+   Pacman pacman;
+   GhostManager ghosts;
+   bool game_won = 0;
+   unsigned char level = 0;
+   unsigned char lives = 0;
+   int score = 0;
+   unsigned short flash_start = 0;
+};
+
+// the fixed 60 Hz step, time piles up as lag and is paid out one tick at a time. A paused clock lets
+// the time go by without piling it up, and resuming starts over from then, so a pause is never
+// caught up in a burst of ticks
+class TickClock
+{
+   bool paused;
+   unsigned lag;
+   chrono::steady_clock::time_point previous_time;
+   chrono::steady_clock::time_point previous_draw;
+
+public:
+   TickClock() : paused(0), lag(0) {}
+
+   bool get_paused() const { return paused; }
+   unsigned get_lag() const { return lag; }
+   chrono::steady_clock::time_point get_time() const { return previous_time; }
+   // when the tick just paid out was due
+   chrono::steady_clock::time_point get_tick_time() const { return previous_time - chrono::microseconds(lag); }
+
+   void start(chrono::steady_clock::time_point now);
+   void set_paused(bool value, chrono::steady_clock::time_point now);
+   void advance(chrono::steady_clock::time_point now);
+   // 1 while a tick is due, every call pays one out
+   bool next_tick();
+   // 1 when the frame is worth drawing again: after a tick, or between ticks as often as the display
+   // can show the actors moving. A paused game is frozen and never asks for one
+   bool frame_due(bool ticked);
+};
+
+void TickClock::start(chrono::steady_clock::time_point now)
+{
+   paused = 0;
+   lag = 0;
+   previous_time = now;
+   previous_draw = now;
+}
+
+void TickClock::set_paused(bool value, chrono::steady_clock::time_point now)
+{
+   if (paused && !value)
+   {
+      lag = 0;
+      previous_time = now;
+   }
+
+   paused = value;
+}
+
+void TickClock::advance(chrono::steady_clock::time_point now)
+{
+   unsigned delta_time = static_cast<unsigned>(chrono::duration_cast<chrono::microseconds>(now - previous_time).count());
+   previous_time += chrono::microseconds(delta_time);
+
+   if (!paused)
+   {
+      lag += delta_time;
+   }
+}
+
+bool TickClock::next_tick()
+{
+   if (paused || lag < FRAME_DURATION)
+   {
+      return 0;
+   }
+
+   lag -= FRAME_DURATION;
+   return 1;
+}
+
+bool TickClock::frame_due(bool ticked)
+{
+   if (paused || (!ticked && previous_time - previous_draw < chrono::microseconds(MIN_DRAW_DURATION)))
+   {
+      return 0;
+   }
+
+   previous_draw = previous_time;
+   return 1;
+}
+
+// gameplay, a fixed 60 Hz simulation on the main thread that publishes a snapshot every tick.
+// While the game is on screen a render thread owns the window's context and draws the newest
+// snapshot, the pause screen draws the last one from the main thread
+class GameScene : public Scene
+{
+   SceneContext& context;
+   AudioEventQueue& audio_events;
+
+   bool active;
+   bool paused;
+   bool pause_key_pressed;
+   bool score_saved;
+   // which message the message layer holds, 0 for none
+   unsigned char message;
+   // pays the ticks out, none while the pause screen is up
+   TickClock clock;
+   // the pause screen has come up or had input, the frozen frame is drawn once more
+   bool paused_redraw;
+   // when the last tick was due, snapshots carry it so frames know how far to blend
+   chrono::time_point<chrono::steady_clock> tick_time;
+
+   GameSimulation simulation;
+   // read again on every new game
+   LevelTable levels;
+   // every tick's input and hash while --record is on
+   ofstream recording;
+
+   TripleBuffer<GameSnapshot> snapshots;
+
+   // drawing side, only touched by whichever thread draws
+   // the maze only changes on a new map, pellets when one is eaten, messages when the state does
+   unsigned drawn_maze_version;
+   unsigned drawn_map_version;
+   RenderLayer walls_layer;
+   RenderLayer pellets_layer;
+   RenderLayer message_layer;
+   // the finished native frame, upscaled to the window in one quad
+   ScaledFrame frame;
+
+   Hud hud;
+   SpriteBatch actors;
+
+   std::atomic<bool> rendering;
+   Thread render_thread;
+   // the tick and display time of every frame the render thread showed, for the input latency.
+   // Snapshots go the other way through the triple buffer since the renderer only wants the newest
+   SpscQueue<FrameReport, FRAME_REPORT_QUEUE_SIZE> frame_reports;
+
+   InputQueue input_events;
+   InputLatch input;
+
+public:
+   GameScene(SceneContext& in_context, AudioEventQueue& in_audio_events);
+   ~GameScene() { stop_rendering(); }
+
+   void enter() override;
+   void exit() override;
+   void handle_event(const Event& event) override;
+   bool update() override;
+   void draw() override;
+   void draw(RenderTarget& window);
+   void presented() override;
+   bool draws_itself() const override { return rendering; }
+   Time idle_wait() const override;
+
+   void set_paused(bool value);
+
+private:
+   void draw_message(RenderTarget& window, const GameSnapshot& frame);
+   void publish();
+   void render();
+   void save_game_score();
+   void start_rendering();
+   void stop_rendering();
+   void tick();
+};
+
+GameScene::GameScene(SceneContext& in_context, AudioEventQueue& in_audio_events) :
+   context(in_context),
+   audio_events(in_audio_events),
+   active(0),
+   paused(0),
+   pause_key_pressed(0),
+   score_saved(0),
+   message(0),
+   paused_redraw(0),
+   drawn_maze_version(0),
+   drawn_map_version(0),
+   rendering(0),
+   render_thread(&GameScene::render, this)
+{
+}
+
+void GameScene::enter()
+{
+   context.window.setTitle("Pac-Man");
+
+   active = 1;
+   paused = 0;
+   score_saved = 0;
+
+   Uint32 seed = static_cast<Uint32>(time(0));
+
+   levels.load(LEVELS_FILE);
+   simulation.start(seed, levels);
+   input_events.clear();
+   input.reset();
+   hud = Hud();
+
+   if (!record_path.empty())
+   {
+      recording.close();
+      recording.clear();
+      recording.open(record_path);
+      recording << REPLAY_HEADER << ' ' << seed << '\n';
+   }
+
+   clock.start(chrono::steady_clock::now());
+   tick_time = clock.get_time();
+   FrameReport report;
+   while (frame_reports.pop(report));
+   drawn_maze_version = simulation.get_maze_version() - 1;
+
+   publish();
+   start_rendering();
+
+   context.music.play(GameTrack);
+}
+
+void GameScene::exit()
+{
+   stop_rendering();
+
+   active = 0;
+   hud.report();
+   input.report();
+   recording.close();
+
+   // leaving in the middle of a game still keeps the score
+   if (simulation.get_score() > 0)
+   {
+      save_game_score();
+   }
+
+   context.music.stop();
+}
+
+void GameScene::handle_event(const Event& event)
+{
+   input_events.push(event);
+   paused_redraw |= paused;
+
+   unsigned char action;
+   bool pressed;
+
+   // Pause/Resume functionality using the scene stack, right away since it has to work while paused
+   if (!InputQueue::action_of(event, action, pressed) || InputPause != action)
+   {
+      return;
+   }
+
+   if (pressed)
+   {
+      if (!pause_key_pressed)
+      {
+         pause_key_pressed = 1;
+
+         if (!paused)
+         {
+            context.scenes.push(PauseScreen);
+         }
+         else
+         {
+            context.scenes.pop();
+         }
+      }
+   }
+   else
+   {
+      pause_key_pressed = 0;
+   }
+}
+
+bool GameScene::update()
+{
+   clock.advance(chrono::steady_clock::now());
+
+   bool ticked = 0;
+
+   // the pause screen calls this too, a paused clock pays out no ticks
+   while (active && clock.next_tick())
+   {
+      tick_time = clock.get_tick_time();
+      tick();
+      publish();
+      ticked = 1;
+   }
+
+   if (rendering)
+   {
+      array<FrameReport, FRAME_REPORT_QUEUE_SIZE> reports;
+
+      for (size_t a = frame_reports.pop(reports.data(), reports.size()), b = 0; b < a; b++)
+      {
+         input.presented(reports[b].tick, reports[b].time);
+      }
+
+      // the main thread only mixes the tick's sounds, the render thread draws on its own
+      return active && ticked;
+   }
+
+   // a paused frame only changes when the pause screen comes up or on input, the loop adds
+   // exposes and resizes
+   if (paused_redraw)
+   {
+      paused_redraw = 0;
+      return active;
+   }
+
+   return active && clock.frame_due(ticked);
+}
+
+// while the render thread draws, the main thread only wakes for input and the next tick.
+// A paused game has no ticks coming, it sleeps like a menu until the key that resumes it
+Time GameScene::idle_wait() const
+{
+   if (paused)
+   {
+      return milliseconds(MENU_IDLE_WAIT_MS);
+   }
+
+   return rendering ? microseconds(FRAME_DURATION - min<unsigned>(clock.get_lag(), FRAME_DURATION)) : Time::Zero;
+}
+
+void GameScene::presented()
+{
+   input.presented(snapshots.get().tick, chrono::steady_clock::now());
+}
+
+void GameScene::set_paused(bool value)
+{
+   paused = value;
+   paused_redraw = value;
+   clock.set_paused(value, chrono::steady_clock::now());
+
+   if (paused)
+   {
+      // the pause screen draws from the main thread
+      stop_rendering();
+      context.music.pause();
+   }
+   else
+   {
+      start_rendering();
+      context.music.resume();
+   }
+}
+
+void GameScene::start_rendering()
+{
+   if (!rendering)
+   {
+      // a context is active in one thread at a time
+      context.window.setActive(0);
+      rendering = 1;
+      render_thread.launch();
+   }
+}
+
+void GameScene::stop_rendering()
+{
+   if (rendering)
+   {
+      rendering = 0;
+      render_thread.wait();
+   }
+}
+
+void GameScene::draw()
+{
+   frame.present(context.window, CELL_SIZE * MAP_WIDTH, FONT_HEIGHT + CELL_SIZE * MAP_HEIGHT, [this](RenderTarget& target) { draw(target); });
+}
+
+void GameScene::render()
+{
+   RenderWindow& window = context.window;
+   window.setActive(1);
+
+   while (rendering)
+   {
+      chrono::time_point<chrono::steady_clock> start = chrono::steady_clock::now();
+
+      draw();
+      window.display();
+
+      // a full queue only loses latency samples
+      frame_reports.push({snapshots.get().tick, chrono::steady_clock::now()});
+
+      // capped like the frames drawn between ticks on the main thread
+      chrono::microseconds spent = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start);
+
+      if (chrono::microseconds(MIN_DRAW_DURATION) > spent)
+      {
+         sf::sleep(microseconds(MIN_DRAW_DURATION - static_cast<Int64>(spent.count())));
+      }
+   }
+
+   window.setActive(0);
+}
+
+// a whole copy every tick, a few hundred bytes of map is cheaper than tracking deltas across dropped snapshots
+void GameScene::publish()
+{
+   GameSnapshot& snapshot = snapshots.write();
+
+   snapshot.tick = simulation.get_tick();
+   snapshot.time = tick_time;
+   snapshot.maze_version = simulation.get_maze_version();
+   snapshot.map_version = simulation.get_map_version();
+   snapshot.map = simulation.get_map();
+   snapshot.pacman = simulation.get_pacman();
+   snapshot.ghosts = simulation.get_ghosts();
+   snapshot.game_won = simulation.get_game_won();
+   snapshot.level = simulation.get_level();
+   snapshot.lives = simulation.get_lives();
+   snapshot.score = simulation.get_score();
+   snapshot.flash_start = simulation.get_settings().flash_start;
+
+   snapshots.publish();
+}
+
+// once per game, whether it ended or was left
+void GameScene::save_game_score()
+{
+   if (!score_saved)
+   {
+      score_saved = 1;
+      context.score_list.add(context.player_name, simulation.get_score());
+      save_score(context.player_name, simulation.get_score());
+   }
+}
+
+void GameScene::tick()
+{
+   input.latch(input_events, simulation.get_tick() + 1);
+
+   TickInput tick_input = {input.get_turn(), input.get_held_directions(), input.is_held(InputConfirm) || input.was_pressed(InputConfirm)};
+   TickEvent event = simulation.step(tick_input, audio_events);
+   input.turn_taken(simulation.get_pacman().get_direction());
+
+   if (recording.is_open())
+   {
+      write_replay_tick(recording, tick_input, simulation.hash());
+   }
+
+   switch (event)
+   {
+      case TickDied: context.music.play(DeathTrack); break;
+      case TickRespawned: context.music.play(GameTrack); break;
+      case TickGameOver:
+      {
+         save_game_score();
+
+         // game over, back to the lobby
+         context.scenes.replace(LobbyScreen);
+         break;
+      }
+      default: break;
+   }
+}
+
+void GameScene::draw(RenderTarget& window)
+{
+   snapshots.read();
+
+   const GameSnapshot& frame = snapshots.get();
+   const Pacman& pacman = frame.pacman;
+   bool game_won = frame.game_won;
+   unsigned char lives = frame.lives;
+
+   // how far the clock is past the snapshot's tick, actors are drawn that far towards it from the tick before
+   float alpha = min(1.f, chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - frame.time).count() / static_cast<float>(FRAME_DURATION));
+
+   if (drawn_maze_version != frame.maze_version)
+   {
+      drawn_maze_version = frame.maze_version;
+      walls_layer.invalidate();
+   }
+
+   if (drawn_map_version != frame.map_version)
+   {
+      drawn_map_version = frame.map_version;
+      pellets_layer.invalidate();
+   }
+
+   hud.update(frame.level, frame.score, lives);
+
+   bool is_game_over = pacman.get_dead() && pacman.get_animation_over() && lives == 0;
+
+   if (is_game_over)
+   {
+      window.clear(Color(135, 206, 250));
+   }
+   else
+   {
+      window.clear();
+   }
+
+   if (!game_won && !pacman.get_dead())
+   {
+      walls_layer.draw(window, CELL_SIZE * MAP_WIDTH, CELL_SIZE * MAP_HEIGHT, [&frame](RenderTarget& target) { draw_map(frame.map, target, 1); });
+      pellets_layer.draw(window, CELL_SIZE * MAP_WIDTH, CELL_SIZE * MAP_HEIGHT, [&frame](RenderTarget& target) { draw_map(frame.map, target, 0); });
+      hud.draw(window);
+   }
+
+   // every actor in one draw call, ghosts first so Pac-Man stays on top
+   actors.clear();
+   if (!game_won && !pacman.get_dead())
+   {
+      frame.ghosts.draw(frame.flash_start >= pacman.get_energizer_timer(), alpha, actors);
+   }
+   pacman.draw(game_won, alpha, actors);
+   actors.draw(window);
+
+   unsigned char next_message = 0;
+
+   if (pacman.get_animation_over())
+   {
+      if (game_won)
+      {
+         next_message = 1;
+      }
+      else if (lives == 0)
+      {
+         next_message = 2;
+      }
+      else
+      {
+         next_message = 3;
+      }
+   }
+
+   if (next_message != message)
+   {
+      message = next_message;
+      message_layer.invalidate();
+   }
+
+   if (message)
+   {
+      message_layer.draw(window, CELL_SIZE * MAP_WIDTH, CELL_SIZE * MAP_HEIGHT, [this, &frame](RenderTarget& target) { draw_message(target, frame); });
+   }
+}
+
+void GameScene::draw_message(RenderTarget& window, const GameSnapshot& frame)
+{
+   if (frame.game_won)
+   {
+      draw_text(1, 0, 0, "Next level!", window);
+   }
+   else if (frame.lives == 0)
+   {
+      unsigned char character_width = static_cast<unsigned char>(ATLAS_FONT.width / 96);
+
+      unsigned short screen_width = CELL_SIZE * MAP_WIDTH;
+      unsigned short screen_height = CELL_SIZE * MAP_HEIGHT;
+
+      unsigned short center_y = screen_height / 2;
+      unsigned short line_spacing = FONT_HEIGHT * 8;
+
+      // gameover interefrence
+      std::string gameOverText = "Game over";
+      unsigned short gameOverX = (screen_width - gameOverText.length() * character_width) / 2;
+      unsigned short gameOverY = center_y - line_spacing * 2;
+      draw_text(0, gameOverX, gameOverY, gameOverText, window);
+
+      string finalScore = "Final Score: " + std::to_string(frame.score);
+      unsigned short scoreX = (screen_width - finalScore.length() * character_width) / 2;
+      unsigned short scoreY = center_y - line_spacing / 2;
+      draw_text(0, scoreX, scoreY, finalScore, window);
+
+      string playerInfo = "Player: " + context.player_name;
+      unsigned short playerX = (screen_width - playerInfo.length() * character_width) / 2;
+      unsigned short playerY = center_y + line_spacing / 2;
+      draw_text(0, playerX, playerY, playerInfo, window);
+
+      string instructionText = "Press Enter to return";
+      unsigned short instX = (screen_width - instructionText.length() * character_width) / 2;
+      unsigned short instY = center_y + line_spacing * 2;
+      draw_text(0, instX, instY, instructionText, window);
+   }
+   else if (frame.lives > 0)
+   {
+      // lives for respawn pacman ko phirse zinda karo
+      unsigned char character_width = static_cast<unsigned char>(ATLAS_FONT.width / 96);
+
+      unsigned short screen_width = CELL_SIZE * MAP_WIDTH;
+      unsigned short screen_height = CELL_SIZE * MAP_HEIGHT;
+
+      unsigned short center_y = screen_height / 2;
+
+      string respawnText = "Lives left: " + std::to_string(frame.lives);
+      unsigned short respawnX = (screen_width - respawnText.length() * character_width) / 2;
+      unsigned short respawnY = center_y - FONT_HEIGHT * 2;
+      draw_text(0, respawnX, respawnY, respawnText, window);
+
+      string pressEnterText = "Press Enter to continue";
+      unsigned short enterX = (screen_width - pressEnterText.length() * character_width) / 2;
+      unsigned short enterY = center_y;
+      draw_text(0, enterX, enterY, pressEnterText, window);
+   }
+}
+
+// pause overlay, sits on top of the game in the scene stack
+class PauseScene : public Scene
+{
+   SceneContext& context;
+   GameScene& game;
+
+   // the game is frozen while paused, so a paused frame is the cached game plus the cached overlay
+   RenderLayer game_layer;
+   RenderLayer overlay_layer;
+   ScaledFrame frame;
+
+public:
+   PauseScene(SceneContext& in_context, GameScene& in_game) : context(in_context), game(in_game) {}
+
+   void enter() override
+   {
+      game.set_paused(1);
+      game_layer.invalidate();
+   }
+   void exit() override { game.set_paused(0); }
+   void handle_event(const Event& event) override { game.handle_event(event); }
+   void presented() override { game.presented(); }
+   bool update() override { return game.update(); }
+   Time idle_wait() const override { return game.idle_wait(); }
+
+   void draw() override;
+
+private:
+   void draw_overlay(RenderTarget& window);
+};
+
+void PauseScene::draw()
+{
+   RenderWindow& window = context.window;
+   unsigned short width = CELL_SIZE * MAP_WIDTH;
+   unsigned short height = FONT_HEIGHT + CELL_SIZE * MAP_HEIGHT;
+
+   frame.present(window, width, height, [&](RenderTarget& target)
+   {
+      game_layer.draw(target, width, height, [this](RenderTarget& layer) { game.draw(layer); });
+      overlay_layer.draw(target, width, height, [this](RenderTarget& layer) { draw_overlay(layer); });
+   });
+}
+
+void PauseScene::draw_overlay(RenderTarget& window)
+{
+   unsigned char character_width = static_cast<unsigned char>(ATLAS_FONT.width / 96);
+
+   unsigned short screen_width = CELL_SIZE * MAP_WIDTH;
+   unsigned short screen_height = CELL_SIZE * MAP_HEIGHT;
+
+   // Draw semi-transparent overlay
+   RectangleShape overlay;
+   overlay.setSize(Vector2f(screen_width, screen_height));
+   overlay.setFillColor(Color(0, 0, 0, 180));
+   window.draw(overlay);
+
+   unsigned short center_y = screen_height / 2;
+   unsigned short line_spacing = FONT_HEIGHT * 4;
+
+   // Pause text
+   string pauseText = "GAME PAUSED";
+   unsigned short pauseX = (screen_width - pauseText.length() * character_width) / 2;
+   unsigned short pauseY = center_y - line_spacing;
+   draw_text(0, pauseX, pauseY, pauseText, window);
+
+   // Resume instruction
+   string resumeText = "Press P to Resume";
+   unsigned short resumeX = (screen_width - resumeText.length() * character_width) / 2;
+   unsigned short resumeY = center_y;
+   draw_text(0, resumeX, resumeY, resumeText, window);
+}
+
+// ghost cost as the count grows, run headless with --bench-ghosts
+int run_ghost_benchmark()
+{
+   const unsigned short counts[] = {4, 16, 64, 256, 1024};
+   const unsigned short ticks = 2000;
+
+   for (unsigned short count : counts)
+   {
+      array<Position, 4> ghost_positions;
+      Pacman pacman;
+      array<array<Cell, MAP_HEIGHT>, MAP_WIDTH> map = convert_sketch(MAP_SKETCH, ghost_positions, pacman);
+
+      WallBitboard wall_bits;
+      wall_bits.build(map);
+      JunctionTable junctions;
+      junctions.build(map);
+      FlowField chase_field;
+      chase_field.build(map);
+
+      GhostManager ghosts(count);
+      ghosts.reset(LevelTable::defaults(0), ghost_positions);
+      ghosts.seed(1);
+
+      chrono::time_point<chrono::steady_clock> start = chrono::steady_clock::now();
+
+      for (unsigned short a = 0; a < ticks; a++)
+      {
+         chase_field.set_target(pacman.get_position());
+         ghosts.update(wall_bits, &junctions, &chase_field, pacman);
+      }
+
+      double ns = static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+      std::cout << "Ghosts: " << count << " ghosts, " << ns / ticks / 1000 << " us per tick, " << ns / ticks / count << " ns per ghost, " << chase_field.get_searches() << " chase field searches\n";
+   }
+
+   return 0;
+}
+
+// a chase field that repairs only the tiles whose distance changes when the target steps or the
+// doors open or close, kept for --bench-flow-field. A target step shifts nearly every distance by one,
+// so the repair costs more than a search there, and the game never opens the doors to the field,
+// which is why the ghosts chase on the plain FlowField
+class RepairingFlowField : public FlowField
+{
+   array<array<bool, MAP_HEIGHT>, MAP_WIDTH> affected;
+   vector<Position> doors;
+   vector<Position> affected_tiles;
+   // tiles waiting by distance while the repair settles them in order
+   array<vector<Position>, FLOW_MAX_DISTANCE> buckets;
+   bool doors_open;
+   unsigned long repairs;
+
+   // the tiles just lost a source or a neighbour, every tile whose distance leaned on them is settled again
+   void raise(const vector<Position>& tiles);
+
+public:
+   RepairingFlowField();
+
+   unsigned long get_repairs() const { return repairs; }
+   unsigned long get_settled_tiles() const { return settled_tiles; }
+
+   // doors start shut
+   void build(const array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map);
+   void set_target(const Position& position, bool repair = 0);
+   void set_doors_open(bool open_doors, bool repair = 1);
+};
+
+RepairingFlowField::RepairingFlowField() :
+   affected{},
+   doors_open(0),
+   repairs(0)
+{
+}
+
+void RepairingFlowField::build(const array<array<Cell, MAP_HEIGHT>, MAP_WIDTH>& map)
+{
+   FlowField::build(map);
+   doors.clear();
+
+   for (unsigned char a = 0; a < MAP_WIDTH; a++)
+   {
+      for (unsigned char b = 0; b < MAP_HEIGHT; b++)
+      {
+         if (Cell::Door == map[a][b])
+         {
+            doors.push_back({static_cast<short>(a), static_cast<short>(b)});
+         }
+      }
+   }
+
+   doors_open = 0;
+}
+
+void RepairingFlowField::set_target(const Position& position, bool repair)
+{
+   Position tile = tile_at(position.x, position.y);
+
+   if (is_target(tile))
+   {
+      return;
+   }
+
+   Position previous = target;
+   target = tile;
+
+   // both ends have to be on the field, anything else (respawns, the first target) is searched whole
+   if (!repair || !reachable(previous) || !reachable(tile))
+   {
+      search();
+
+      return;
+   }
+
+   repairs++;
+
+   // for a moment both tiles are sources, then the old one gives its place up
+   distance[tile.x][tile.y] = 0;
+   lower(tile);
+   raise({previous});
+}
+
+void RepairingFlowField::set_doors_open(bool open_doors, bool repair)
+{
+   if (open_doors == doors_open)
+   {
+      return;
+   }
+
+   doors_open = open_doors;
+
+   for (const Position& door : doors)
+   {
+      open[door.x][door.y] = open_doors;
+   }
+
+   // a target standing in a doorway had no field to repair
+   if (!repair || !reachable(target) || 0 != distance[target.x][target.y])
+   {
+      search();
+
+      return;
+   }
+
+   repairs++;
+
+   if (open_doors)
+   {
+      for (const Position& door : doors)
+      {
+         int best = FLOW_UNREACHED;
+
+         for (unsigned char a = 0; a < 4; a++)
+         {
+            Position next;
+
+            if (neighbour(door, a, next) && open[next.x][next.y])
+            {
+               best = min<int>(best, 1 + distance[next.x][next.y]);
+            }
+         }
+
+         distance[door.x][door.y] = static_cast<unsigned short>(min<int>(best, FLOW_UNREACHED));
+
+         if (FLOW_UNREACHED != distance[door.x][door.y])
+         {
+            lower(door);
+         }
+      }
+   }
+   else
+   {
+      // the doors drop out of the maze, the tiles that were reached through them start over
+      vector<Position> neighbours;
+
+      for (const Position& door : doors)
+      {
+         for (unsigned char a = 0; a < 4; a++)
+         {
+            Position next;
+
+            if (neighbour(door, a, next) && open[next.x][next.y] && distance[next.x][next.y] == 1 + distance[door.x][door.y])
+            {
+               neighbours.push_back(next);
+            }
+         }
+      }
+
+      for (const Position& door : doors)
+      {
+         distance[door.x][door.y] = FLOW_UNREACHED;
+      }
+
+      raise(neighbours);
+   }
+}
+
+void RepairingFlowField::raise(const vector<Position>& tiles)
+{
+   unsigned short first = FLOW_MAX_DISTANCE;
+   unsigned short last = 0;
+
+   for (const Position& tile : tiles)
+   {
+      if (FLOW_UNREACHED != distance[tile.x][tile.y])
+      {
+         buckets[distance[tile.x][tile.y]].push_back(tile);
+         first = min(first, distance[tile.x][tile.y]);
+         last = max(last, distance[tile.x][tile.y]);
+      }
+   }
+
+   // nearest first, a tile is affected when no settled neighbour is still one step closer than it
+   for (unsigned short a = first; a <= last; a++)
+   {
+      for (size_t b = 0; b < buckets[a].size(); b++)
+      {
+         Position tile = buckets[a][b];
+         bool supported = 0;
+
+         if (affected[tile.x][tile.y] || is_target(tile))
+         {
+            continue;
+         }
+
+         for (unsigned char c = 0; c < 4; c++)
+         {
+            Position next;
+
+            if (neighbour(tile, c, next) && open[next.x][next.y] && !affected[next.x][next.y] && 1 + distance[next.x][next.y] == a)
+            {
+               supported = 1;
+
+               break;
+            }
+         }
+
+         if (supported)
+         {
+            continue;
+         }
+
+         affected[tile.x][tile.y] = 1;
+         affected_tiles.push_back(tile);
+
+         for (unsigned char c = 0; c < 4; c++)
+         {
+            Position next;
+
+            if (neighbour(tile, c, next) && open[next.x][next.y] && distance[next.x][next.y] == 1 + a)
+            {
+               buckets[1 + a].push_back(next);
+               last = max<unsigned short>(last, 1 + a);
+            }
+         }
+      }
+
+      buckets[a].clear();
+   }
+
+   // the affected tiles take their distance from the settled ones around them, then settle each other in order
+   first = FLOW_MAX_DISTANCE;
+   last = 0;
+
+   for (const Position& tile : affected_tiles)
+   {
+      int best = FLOW_UNREACHED;
+
+      for (unsigned char a = 0; a < 4; a++)
+      {
+         Position next;
+
+         if (neighbour(tile, a, next) && open[next.x][next.y] && !affected[next.x][next.y])
+         {
+            best = min<int>(best, 1 + distance[next.x][next.y]);
+         }
+      }
+
+      distance[tile.x][tile.y] = static_cast<unsigned short>(min<int>(best, FLOW_UNREACHED));
+
+      if (FLOW_UNREACHED != distance[tile.x][tile.y])
+      {
+         buckets[distance[tile.x][tile.y]].push_back(tile);
+         first = min(first, distance[tile.x][tile.y]);
+         last = max(last, distance[tile.x][tile.y]);
+      }
+   }
+
+   for (unsigned short a = first; a <= last; a++)
+   {
+      for (size_t b = 0; b < buckets[a].size(); b++)
+      {
+         Position tile = buckets[a][b];
+
+         // queued again with a shorter distance since
+         if (distance[tile.x][tile.y] != a)
+         {
+            continue;
+         }
+
+         for (unsigned char c = 0; c < 4; c++)
+         {
+            Position next;
+
+            if (neighbour(tile, c, next) && affected[next.x][next.y] && 1 + a < distance[next.x][next.y])
+            {
+               distance[next.x][next.y] = 1 + a;
+               buckets[1 + a].push_back(next);
+               last = max<unsigned short>(last, 1 + a);
+            }
+         }
+      }
+
+      buckets[a].clear();
+   }
+
+   for (const Position& tile : affected_tiles)
+   {
+      affected[tile.x][tile.y] = 0;
+   }
+
+   settled_tiles += affected_tiles.size();
+   affected_tiles.clear();
+}
+
+// repairing the chase field as Pac-Man walks against searching it again and against one
+// bfs_next_direction per ghost, with the doors flipping now and then, run headless with --bench-flow-field
+int run_flow_field_benchmark()
+{
+   const unsigned short steps = 20000;
+   const unsigned char ghost_count = 4;
+   const unsigned char door_interval = 64;
+   static const short step_x[4] = {1, 0, -1, 0};
+   static const short step_y[4] = {0, -1, 0, 1};
+
+   array<Position, 4> ghost_positions;
+   Pacman pacman;
+   array<array<Cell, MAP_HEIGHT>, MAP_WIDTH> map = convert_sketch(MAP_SKETCH, ghost_positions, pacman);
+
+   vector<Position> open_tiles;
+   for (unsigned char a = 0; a < MAP_WIDTH; a++)
+   {
+      for (unsigned char b = 0; b < MAP_HEIGHT; b++)
+      {
+         if (Cell::Wall != map[a][b] && Cell::Door != map[a][b])
+         {
+            open_tiles.push_back({static_cast<short>(CELL_SIZE * a), static_cast<short>(CELL_SIZE * b)});
+         }
+      }
+   }
+
+   // the walk is worked out up front so every method times the same moves
+   srand(1);
+   vector<Position> walk;
+   Position tile = {static_cast<short>(pacman.get_position().x / CELL_SIZE), static_cast<short>(pacman.get_position().y / CELL_SIZE)};
+
+   while (walk.size() < steps)
+   {
+      unsigned char direction = rand() % 4;
+      Position next = {static_cast<short>((tile.x + step_x[direction] + MAP_WIDTH) % MAP_WIDTH), static_cast<short>(tile.y + step_y[direction])};
+
+      if (0 <= next.y && next.y < MAP_HEIGHT && Cell::Wall != map[next.x][next.y] && Cell::Door != map[next.x][next.y])
+      {
+         tile = next;
+         walk.push_back({static_cast<short>(CELL_SIZE * tile.x), static_cast<short>(CELL_SIZE * tile.y)});
+      }
+   }
+
+   vector<Position> ghosts;
+   for (unsigned char a = 0; a < ghost_count; a++)
+   {
+      ghosts.push_back(open_tiles[rand() % open_tiles.size()]);
+   }
+
+   const unsigned short flips = 2000;
+   chrono::time_point<chrono::steady_clock> start;
+   double repair_ns[2];
+   double search_ns[2];
+   unsigned long repaired_tiles[2];
+
+   // first the target walks with the doors shut, then the doors flip under a standing target
+   for (unsigned char a = 0; a < 2; a++)
+   {
+      RepairingFlowField repaired;
+      RepairingFlowField searched;
+      repaired.build(map);
+      searched.build(map);
+      repaired.set_target(walk[0]);
+      searched.set_target(walk[0]);
+
+      unsigned short count = 0 == a ? steps : flips;
+
+      start = chrono::steady_clock::now();
+      for (unsigned short b = 0; b < count; b++)
+      {
+         if (0 == a)
+         {
+            repaired.set_target(walk[b], 1);
+         }
+         else
+         {
+            repaired.set_doors_open(~b & 1);
+         }
+      }
+      repair_ns[a] = static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count()) / count;
+
+      start = chrono::steady_clock::now();
+      for (unsigned short b = 0; b < count; b++)
+      {
+         if (0 == a)
+         {
+            searched.set_target(walk[b]);
+         }
+         else
+         {
+            searched.set_doors_open(~b & 1, 0);
+         }
+      }
+      search_ns[a] = static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count()) / count;
+
+      repaired_tiles[a] = repaired.get_settled_tiles() / max<unsigned long>(1, repaired.get_repairs());
+   }
+
+   vector<int> directions(ghost_count);
+   start = chrono::steady_clock::now();
+   for (unsigned short a = 0; a < steps; a++)
+   {
+      for (unsigned char b = 0; b < ghost_count; b++)
+      {
+         directions[b] = bfs_next_direction(map, ghosts[b], walk[a]);
+      }
+   }
+   double bfs_ns = static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count()) / steps;
+
+   // a second pair of fields walks the same path with the doors flipping and compares every step
+   RepairingFlowField checked;
+   RepairingFlowField reference;
+   checked.build(map);
+   reference.build(map);
+
+   unsigned short mismatches = 0;
+   for (unsigned short a = 0; a < steps; a++)
+   {
+      checked.set_doors_open(a / door_interval & 1);
+      checked.set_target(walk[a], 1);
+      reference.set_doors_open(a / door_interval & 1, 0);
+      reference.set_target(walk[a]);
+
+      mismatches += !checked.same_distances(reference);
+   }
+
+   std::cout << "Flow field: target step, repair " << repair_ns[0] << " ns (" << repaired_tiles[0] << " tiles), full search " << search_ns[0] << " ns, bfs_next_direction for " << static_cast<unsigned short>(ghost_count) << " ghosts " << bfs_ns << " ns\n";
+   std::cout << "Flow field: door flip, repair " << repair_ns[1] << " ns (" << repaired_tiles[1] << " tiles), full search " << search_ns[1] << " ns\n";
+   std::cout << "Flow field: " << steps << " steps, " << mismatches << " differing from a full search\n";
+
+   return mismatches ? 1 : 0;
+}
+
+constexpr size_t BENCH_QUEUE_SIZE = 1024;
+constexpr unsigned char BENCH_QUEUE_BATCH = 32;
+
+// waiting on the other thread spins, but gives the core up now and then in case both share one
+void queue_backoff(unsigned& spins)
+{
+   if (0 == ++spins % 64)
+   {
+      std::this_thread::yield();
+   }
+}
+
+// items from producers threads (values 1 to items, split between them) to the calling thread,
+// returns nanoseconds per item and 0 in checksum when something got lost or doubled
+template<typename Queue>
+double queue_throughput(Queue& queue, unsigned items, unsigned char producers, bool batched, unsigned long long& checksum)
+{
+   vector<unique_ptr<Thread>> threads;
+   unsigned share = items / producers;
+
+   chrono::time_point<chrono::steady_clock> start = chrono::steady_clock::now();
+
+   for (unsigned char a = 0; a < producers; a++)
+   {
+      threads.emplace_back(new Thread([&queue, a, share, batched]()
+      {
+         array<unsigned, BENCH_QUEUE_BATCH> values;
+         unsigned spins = 0;
+
+         for (unsigned b = 1 + a * share; b <= (1 + a) * share;)
+         {
+            unsigned pushed;
+
+            if (batched)
+            {
+               unsigned count = min<unsigned>(BENCH_QUEUE_BATCH, 1 + (1 + a) * share - b);
+               for (unsigned c = 0; c < count; c++)
+               {
+                  values[c] = b + c;
+               }
+
+               pushed = static_cast<unsigned>(queue.push(values.data(), count));
+            }
+            else
+            {
+               pushed = queue.push(b);
+            }
+
+            b += pushed;
+
+            if (!pushed)
+            {
+               queue_backoff(spins);
+            }
+         }
+      }));
+      threads.back()->launch();
+   }
+
+   array<unsigned, BENCH_QUEUE_BATCH> values;
+   unsigned received = 0;
+   unsigned spins = 0;
+   checksum = 0;
+
+   while (received < share * producers)
+   {
+      size_t count = batched ? queue.pop(values.data(), values.size()) : queue.pop(values[0]);
+
+      for (size_t a = 0; a < count; a++)
+      {
+         checksum += values[a];
+      }
+
+      received += static_cast<unsigned>(count);
+
+      if (!count)
+      {
+         queue_backoff(spins);
+      }
+   }
+
+   double ns = static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+
+   for (unique_ptr<Thread>& thread : threads)
+   {
+      thread->wait();
+   }
+
+   unsigned long long total = share * producers;
+   if (total * (total + 1) / 2 != checksum)
+   {
+      checksum = 0;
+   }
+
+   return ns / total;
+}
+
+// one value bounced between two threads, returns nanoseconds for one way
+template<typename Queue>
+double queue_latency(Queue& ping, SpscQueue<unsigned, BENCH_QUEUE_SIZE>& pong, unsigned round_trips)
+{
+   Thread echo([&ping, &pong, round_trips]()
+   {
+      unsigned value;
+      unsigned spins = 0;
+
+      for (unsigned a = 0; a < round_trips; a++)
+      {
+         while (!ping.pop(value))
+         {
+            queue_backoff(spins);
+         }
+
+         while (!pong.push(value))
+         {
+            queue_backoff(spins);
+         }
+      }
+   });
+   echo.launch();
+
+   chrono::time_point<chrono::steady_clock> start = chrono::steady_clock::now();
+
+   unsigned spins = 0;
+
+   for (unsigned a = 0; a < round_trips; a++)
+   {
+      unsigned value;
+
+      while (!ping.push(a))
+      {
+         queue_backoff(spins);
+      }
+
+      while (!pong.pop(value))
+      {
+         queue_backoff(spins);
+      }
+   }
+
+   double ns = static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+   echo.wait();
+
+   return ns / round_trips / 2;
+}
+
+// throughput and latency of each queue, single items against batches of 32, run headless with --bench-queues
+int run_queue_benchmark()
+{
+   const unsigned items = 4000000;
+   const unsigned round_trips = 200000;
+   const unsigned char producers = 3;
+
+   bool lost = 0;
+   unsigned long long checksum;
+
+   {
+      SimpleQueue<unsigned, BENCH_QUEUE_SIZE> queue;
+      array<unsigned, BENCH_QUEUE_BATCH> values;
+      checksum = 0;
+
+      chrono::time_point<chrono::steady_clock> start = chrono::steady_clock::now();
+      for (unsigned a = 0; a < items; a += BENCH_QUEUE_BATCH)
+      {
+         for (unsigned char b = 0; b < BENCH_QUEUE_BATCH; b++)
+         {
+            queue.push(1 + a + b);
+         }
+
+         for (size_t b = queue.pop(values.data(), values.size()), c = 0; c < b; c++)
+         {
+            checksum += values[c];
+         }
+      }
+      double ns = static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+
+      lost |= static_cast<unsigned long long>(items) * (items + 1) / 2 != checksum;
+      std::cout << "Queues: SimpleQueue, one thread, " << ns / items << " ns per item\n";
+   }
+
+   for (bool batched : {false, true})
+   {
+      unique_ptr<SpscQueue<unsigned, BENCH_QUEUE_SIZE>> spsc(new SpscQueue<unsigned, BENCH_QUEUE_SIZE>());
+      double spsc_ns = queue_throughput(*spsc, items, 1, batched, checksum);
+      lost |= 0 == checksum;
+
+      unique_ptr<MpscQueue<unsigned, BENCH_QUEUE_SIZE>> mpsc(new MpscQueue<unsigned, BENCH_QUEUE_SIZE>());
+      double mpsc_ns = queue_throughput(*mpsc, items, producers, batched, checksum);
+      lost |= 0 == checksum;
+
+      std::cout << "Queues: " << (batched ? "batches of 32" : "single items") << ", SpscQueue " << spsc_ns << " ns per item, MpscQueue with "
+                << static_cast<unsigned short>(producers) << " producers " << mpsc_ns << " ns per item\n";
+   }
+
+   unique_ptr<SpscQueue<unsigned, BENCH_QUEUE_SIZE>> pong(new SpscQueue<unsigned, BENCH_QUEUE_SIZE>());
+   unique_ptr<SpscQueue<unsigned, BENCH_QUEUE_SIZE>> spsc(new SpscQueue<unsigned, BENCH_QUEUE_SIZE>());
+   unique_ptr<MpscQueue<unsigned, BENCH_QUEUE_SIZE>> mpsc(new MpscQueue<unsigned, BENCH_QUEUE_SIZE>());
+   double spsc_latency = queue_latency(*spsc, *pong, round_trips);
+   double mpsc_latency = queue_latency(*mpsc, *pong, round_trips);
+
+   std::cout << "Queues: one way between two threads, SpscQueue " << spsc_latency << " ns, MpscQueue " << mpsc_latency << " ns\n";
+   std::cout << "Queues: " << (lost ? "items lost or doubled" : "every item arrived once") << "\n";
+
+   return lost ? 1 : 0;
+}
+
+// plays a recording made with --record and writes it out again with this build's hashes, run
+// headless with --replay. Two builds that print the same file simulate the same game
+int run_replay(const string& file)
+{
+   ifstream ifs(file);
+   string header;
+   Uint32 seed;
+
+   if (!(ifs >> header >> seed) || REPLAY_HEADER != header)
+   {
+      std::cerr << "Replay: " << file << " is not a recording.\n";
+      return 1;
+   }
+
+   // the recording does not carry the level table, a changed levels.cfg shows up as a mismatch
+   LevelTable levels;
+   levels.load(LEVELS_FILE);
+
+   GameSimulation simulation;
+   simulation.start(seed, levels);
+   AudioEventQueue audio_events;
+   array<unsigned char, AUDIO_QUEUE_SIZE> raised;
+
+   unsigned turn;
+   unsigned held;
+   bool confirm;
+   string recorded;
+   unsigned long mismatches = 0;
+   unsigned long first_mismatch = 0;
+
+   std::cout << REPLAY_HEADER << ' ' << seed << '\n';
+
+   while (ifs >> turn >> held >> confirm >> recorded)
+   {
+      TickInput input = {static_cast<unsigned char>(turn), static_cast<unsigned char>(held), confirm};
+      simulation.step(input, audio_events);
+      audio_events.pop(raised.data(), raised.size());
+
+      Uint64 hash = simulation.hash();
+      write_replay_tick(std::cout, input, hash);
+
+      if (recorded != hash_text(hash) && 0 == mismatches++)
+      {
+         first_mismatch = simulation.get_tick();
+      }
+   }
+
+   if (mismatches)
+   {
+      std::cerr << "Replay: " << simulation.get_tick() << " ticks, " << mismatches << " differ from the recording, the first at tick " << first_mismatch << ".\n";
+      return 1;
+   }
+
+   std::cerr << "Replay: " << simulation.get_tick() << " ticks match the recording, final hash " << hash_text(simulation.hash()) << ".\n";
+   return 0;
+}
+
+// plays a recording through a TickClock fed made-up times, an update every 7 ms like a fast display.
+// A third of the way in the game is paused for five seconds while the updates keep coming, the way
+// the pause screen keeps calling GameScene::update, which must neither tick nor ask for the frozen
+// frame to be drawn again. Run headless with --verify-pause [replay]
+int run_pause_verification(const string& file)
+{
+   const unsigned update_interval = 7000;
+   const unsigned pause_length = 5000000;
+
+   ifstream ifs(file);
+   string header;
+   Uint32 seed;
+
+   if (!(ifs >> header >> seed) || REPLAY_HEADER != header)
+   {
+      std::cerr << "Pause: " << file << " is not a recording.\n";
+      return 1;
+   }
+
+   vector<TickInput> inputs;
+   vector<string> hashes;
+   unsigned turn;
+   unsigned held;
+   bool confirm;
+   string recorded;
+
+   while (ifs >> turn >> held >> confirm >> recorded)
+   {
+      inputs.push_back({static_cast<unsigned char>(turn), static_cast<unsigned char>(held), confirm});
+      hashes.push_back(recorded);
+   }
+
+   LevelTable levels;
+   levels.load(LEVELS_FILE);
+
+   GameSimulation simulation;
+   simulation.start(seed, levels);
+   AudioEventQueue audio_events;
+   array<unsigned char, AUDIO_QUEUE_SIZE> raised;
+
+   chrono::steady_clock::time_point now;
+   chrono::steady_clock::time_point resume_time;
+   TickClock clock;
+   clock.start(now);
+
+   size_t played = 0;
+   bool paused_once = 0;
+   unsigned long mismatches = 0;
+   unsigned long paused_ticks = 0;
+   unsigned long paused_frames = 0;
+   unsigned long frames = 0;
+   unsigned most_ticks = 0;
+
+   while (played < inputs.size())
+   {
+      now += chrono::microseconds(update_interval);
+
+      if (!paused_once && inputs.size() / 3 <= played)
+      {
+         paused_once = 1;
+         resume_time = now + chrono::microseconds(pause_length);
+         clock.set_paused(1, now);
+      }
+      else if (clock.get_paused() && resume_time <= now)
+      {
+         clock.set_paused(0, now);
+      }
+
+      clock.advance(now);
+
+      unsigned ticks = 0;
+
+      while (played < inputs.size() && clock.next_tick())
+      {
+         simulation.step(inputs[played], audio_events);
+         audio_events.pop(raised.data(), raised.size());
+
+         mismatches += hashes[played] != hash_text(simulation.hash());
+         played++;
+         ticks++;
+      }
+
+      bool drawn = clock.frame_due(0 < ticks);
+
+      if (clock.get_paused())
+      {
+         paused_ticks += ticks;
+         paused_frames += drawn;
+      }
+
+      frames += drawn;
+      most_ticks = max(most_ticks, ticks);
+   }
+
+   std::cout << "Pause: " << played << " ticks, " << mismatches << " differ from the recording, " << paused_ticks << " ran during a " << pause_length / 1000000 << " s pause, at most " << most_ticks << " per update\n";
+   std::cout << "Pause: " << frames << " frames drawn, " << paused_frames << " of them while paused\n";
+
+   return mismatches || paused_ticks || paused_frames || 1 < most_ticks ? 1 : 0;
+}
+
+// the software renderer over a recorded game, run headless with --bench-raster [replay]. Every frame is
+// also drawn with scalar blits and compared, and the last full-size color frame is written to raster.ppm
+int run_raster_benchmark(const string& file)
+{
+   ifstream ifs(file);
+   string header;
+   Uint32 seed;
+
+   if (!(ifs >> header >> seed) || REPLAY_HEADER != header)
+   {
+      std::cerr << "Raster: " << file << " is not a recording.\n";
+      return 1;
+   }
+
+   vector<TickInput> inputs;
+   unsigned turn;
+   unsigned held;
+   bool confirm;
+   string recorded;
+
+   while (ifs >> turn >> held >> confirm >> recorded)
+   {
+      inputs.push_back({static_cast<unsigned char>(turn), static_cast<unsigned char>(held), confirm});
+   }
+
+   if (inputs.empty())
+   {
+      std::cerr << "Raster: " << file << " has no ticks.\n";
+      return 1;
+   }
+
+   LevelTable levels;
+   levels.load(LEVELS_FILE);
+
+   SoftwareRenderer renderer;
+   AudioEventQueue audio_events;
+   array<unsigned char, AUDIO_QUEUE_SIZE> raised;
+
+   // both kernels draw the background again every frame here, so its blits are compared too
+   unsigned long mismatches = 0;
+   {
+      GameSimulation simulation;
+      simulation.start(seed, levels);
+
+      vector<Uint8> vector_frame(SoftwareRenderer::output_size(PixelIndex, 1));
+      vector<Uint8> scalar_frame(vector_frame.size());
+
+      for (const TickInput& input : inputs)
+      {
+         simulation.step(input, audio_events);
+         audio_events.pop(raised.data(), raised.size());
+
+         renderer.set_vector_blits(1);
+         renderer.invalidate();
+         renderer.render(simulation, vector_frame.data(), PixelIndex);
+         renderer.set_vector_blits(0);
+         renderer.invalidate();
+         renderer.render(simulation, scalar_frame.data(), PixelIndex);
+
+         mismatches += vector_frame != scalar_frame;
+      }
+   }
+
+   const PixelFormat formats[] = {PixelIndex, PixelRgb, PixelRgb, PixelIndex};
+   const unsigned char downsamples[] = {1, 1, 2, 4};
+
+   renderer.set_vector_blits(1);
+
+   for (unsigned char a = 0; a < 4; a++)
+   {
+      GameSimulation simulation;
+      simulation.start(seed, levels);
+      renderer.invalidate();
+
+      unsigned short width = CELL_SIZE * MAP_WIDTH / downsamples[a];
+      unsigned short height = CELL_SIZE * MAP_HEIGHT / downsamples[a];
+      vector<Uint8> pixels(SoftwareRenderer::output_size(formats[a], downsamples[a]));
+      chrono::nanoseconds spent(0);
+
+      for (const TickInput& input : inputs)
+      {
+         simulation.step(input, audio_events);
+         audio_events.pop(raised.data(), raised.size());
+
+         chrono::time_point<chrono::steady_clock> start = chrono::steady_clock::now();
+         renderer.render(simulation, pixels.data(), formats[a], downsamples[a]);
+         spent += chrono::steady_clock::now() - start;
+      }
+
+      double us = spent.count() / 1000.0 / inputs.size();
+
+      std::cout << "Raster: " << (PixelRgb == formats[a] ? "rgb" : "index") << ' ' << width << 'x' << height << ", "
+                << us << " us per frame, " << static_cast<unsigned long>(1000000 / us) << " frames per second\n";
+
+      if (PixelRgb == formats[a] && 1 == downsamples[a])
+      {
+         ofstream ppm("raster.ppm", ios::binary);
+         ppm << "P6\n" << width << ' ' << height << "\n255\n";
+         ppm.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+      }
+   }
+
+#ifdef TILE_BLIT_SSE2
+   const char* vector_kernel = "sse2";
+#else
+   const char* vector_kernel = "scalar fallback";
+#endif
+
+   std::cout << "Raster: " << vector_kernel << " blits, " << mismatches << " of " << inputs.size() << " frames differ from scalar blits, "
+             << renderer.get_palette().size() << " palette colors, last frame in raster.ppm\n";
+
+   return mismatches ? 1 : 0;
 }
 
-// main function start ----//
-int main()
+// a leaderboard server and clients on localhost, run headless with --verify-leaderboard. The server drops the
+// connection instead of acknowledging the first submits, so batches go out again on new connections and have
+// to be counted once. A client whose server never acknowledges has to give up within LEADERBOARD_SHUTDOWN_MS
+int run_leaderboard_verification()
 {
-   // create the score object for 
-   ScoreList score_list;  
-   string player_name = "Player";  
-   int current_score = 0;  // track the score 
-   unsigned score_timer = 0;  // timer
-   
-   
-   load_scores_from_file(score_list);
-   
-   
-   while (true) {
-     
-      int lobby_result = showLobby(score_list.getHead());
-      
-      if (lobby_result == 0) {
-        
-         break;
-      }
-      else if (lobby_result == 2) {
-        
-         showViewScoreScreen(score_list.getHead());
-         continue;
-      }
-      
-   
-      player_name = ask_player_name_bitmap();
-   
- 
-      bool game_won = 0;
-      unsigned lag = 0;
-      unsigned char level = 0;
-      unsigned char lives = 3;  
-      chrono::time_point<chrono::steady_clock> previous_time;
-
-   array<string, MAP_HEIGHT> map_sketch = {
-      " ################### ",
-      " #........#........# ",
-      " #o##.###.#.###.##o# ",
-      " #.................# ",
-      " #.##.#.#####.#.##.# ",
-      " #....#...#...#....# ",
-      " ####.### # ###.#### ",
-      "    #.#   0   #.#    ",
-      "#####.# ##=## #.#####",
-      "     .  #123#  .   ",
-      "#####.# ##### #.#####",
-      "    #.#       #.#    ",
-      " ####.# ##### #.#### ",
-      " #........#........# ",
-      " #.##.###.#.###.##.# ",
-      " #o.#.....P.....#.o# ",
-      " ##.#.#.#####.#.#.## ",
-      " #....#...#...#....# ",
-      " #.######.#.######.# ",
-      " #.................# ",
-      " ################### "
-   };
+   const string save_path = "leaderboard_verify.txt";
+   const unsigned short count = 100;
+   const unsigned char drops = 2;
 
-   array<array<Cell, MAP_HEIGHT>, MAP_WIDTH> map{};
-   array<Position, 4> ghost_positions;
-Event event;
+   std::remove(save_path.c_str());
+
+   LeaderboardServer server(save_path);
+   if (!server.listen(Socket::AnyPort))
+   {
+      return 1;
+   }
 
-RenderWindow window(VideoMode(CELL_SIZE * MAP_WIDTH * SCREEN_RESIZE, (FONT_HEIGHT + CELL_SIZE * MAP_HEIGHT) * SCREEN_RESIZE), "Pac-Man", Style::Close);
-   window.setView(View(FloatRect(0, 0, CELL_SIZE * MAP_WIDTH, FONT_HEIGHT + CELL_SIZE * MAP_HEIGHT)));
+   Thread serve(&LeaderboardServer::serve, &server);
+   serve.launch();
 
-   GhostManager ghost_manager;
-   Pacman pacman;
+   IpAddress local = IpAddress::LocalHost;
+   unsigned short port = server.get_port();
 
-   srand(static_cast<unsigned>(time(0)));
+   server.drop_acks(drops);
+   {
+      // leaving the scope flushes, resends and waits for every ack
+      LeaderboardClient client(local, port);
 
-   map = convert_sketch(map_sketch, ghost_positions, pacman);
-   ghost_manager.reset(level, ghost_positions);
+      for (unsigned short a = 0; a < count; a++)
+      {
+         client.submit("verify" + to_string(a), 10 * a);
+      }
+   }
 
-   previous_time = chrono::steady_clock::now();
+   vector<pair<string, int>> rows = LeaderboardClient::query_top(local, port, 1000);
+   std::map<string, unsigned short> stored;
 
- 
-   sf::Music backgroundMusic;
-   if (!backgroundMusic.openFromFile("Resources/Music/pacman_theme.wav")) {
-      std::cerr << "Failed to load background music.\n";
+   for (const pair<string, int>& row : rows)
+   {
+      stored[row.first]++;
    }
-   backgroundMusic.setLoop(true);
-   backgroundMusic.play();
 
-   sf::SoundBuffer chompBuffer;
-   if (!chompBuffer.loadFromFile("Resources/Music/pacman_chomp.wav")) {
-      std::cerr << "Failed to load chomping sound.\n";
+   unsigned short missing = 0;
+   unsigned short duplicates = 0;
+
+   for (unsigned short a = 0; a < count; a++)
+   {
+      unsigned short copies = stored["verify" + to_string(a)];
+      missing += 0 == copies;
+      duplicates += 1 < copies;
    }
-   sf::Sound chompSound;
-   chompSound.setBuffer(chompBuffer);
 
-  
-   sf::Music deathMusic;
-   if (!deathMusic.openFromFile("Resources/Music/pacman_death.wav")) {
-      std::cerr << "Failed to load death music.\n";
+   int score = -1;
+   unsigned total = 0;
+   bool ranked = count == LeaderboardClient::query_rank(local, port, "verify0", score, total) && 0 == score && count == total;
+
+   // no ack ever comes back now, closing the client must still return
+   server.drop_acks(UINT_MAX);
+   Clock shutdown;
+   {
+      LeaderboardClient client(local, port);
+      client.submit("unacknowledged", 1);
    }
-   deathMusic.setLoop(false); 
-   bool deathSoundPlayed = false;  
-   
-   // Stack for pause/resume functionality
-   SimpleStack<bool, 10> pauseStack;
-   bool isPaused = false;
-   bool pauseKeyPressed = false;
+   float waited = shutdown.getElapsedTime().asSeconds();
+   bool gave_up = waited < LEADERBOARD_SHUTDOWN_MS / 1000.f + 2;
 
-   while (window.isOpen())
+   server.stop();
+   serve.wait();
+   std::remove(save_path.c_str());
+
+   std::cout << "Leaderboard: " << count << " scores over " << static_cast<unsigned>(drops) << " dropped connections, " << rows.size()
+             << " stored, " << missing << " missing, " << duplicates << " counted twice, rank " << (ranked ? "right" : "wrong")
+             << ", unacknowledged client closed after " << waited << " s\n";
+
+   return rows.size() == count && !missing && !duplicates && ranked && gave_up ? 0 : 1;
+}
+
+// map_collision against the bitboard probes on the same positions, run headless with --bench-walls
+int run_wall_probe_benchmark()
+{
+   const unsigned short count = 1024;
+   const unsigned short rounds = 2000;
+
+   array<Position, 4> ghost_positions;
+   Pacman pacman;
+   array<array<Cell, MAP_HEIGHT>, MAP_WIDTH> map = convert_sketch(MAP_SKETCH, ghost_positions, pacman);
+
+   WallBitboard wall_bits;
+   wall_bits.build(map);
+
+   vector<short> x(count);
+   vector<short> y(count);
+   vector<unsigned char> speed(count);
+   vector<unsigned char> use_door(count);
+
+   srand(1);
+   for (unsigned short a = 0; a < count; a++)
    {
-      unsigned delta_time = static_cast<unsigned>(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - previous_time).count());
-      lag += delta_time;
-      previous_time += chrono::microseconds(delta_time);
+      x[a] = static_cast<short>(rand() % (CELL_SIZE * (MAP_WIDTH + 2)) - CELL_SIZE);
+      y[a] = static_cast<short>(rand() % (CELL_SIZE * MAP_HEIGHT));
+      speed[a] = static_cast<unsigned char>(1 + rand() % (GHOST_ESCAPE_SPEED >> FIXED_SHIFT));
+      use_door[a] = static_cast<unsigned char>(rand() % 2);
+   }
 
-      while (FRAME_DURATION <= lag)
-      {
-         lag -= FRAME_DURATION;
+   vector<unsigned char> reference(count);
+   vector<unsigned char> scalar(count);
+   vector<unsigned char> vector_walls(count);
+   double ns[3];
+
+   for (unsigned char kernel = 0; kernel < 3; kernel++)
+   {
+      chrono::time_point<chrono::steady_clock> start = chrono::steady_clock::now();
 
-         while (window.pollEvent(event))
+      for (unsigned short round = 0; round < rounds; round++)
+      {
+         if (0 == kernel)
          {
-            if (Event::Closed == event.type)
+            for (unsigned short a = 0; a < count; a++)
             {
-             
-               if (current_score > 0) {
-                  score_list.add(player_name, current_score);
-                  save_score(player_name, current_score);
-               }
-               window.close();
-               break;  
-            }
-            
-            // Pause/Resume functionality using stack
-            if (event.type == Event::KeyPressed)
-            {
-               if (event.key.code == Keyboard::P)
-               {
-                  if (!pauseKeyPressed)
-                  {
-                     pauseKeyPressed = true;
-                     if (!isPaused)
-                     {
-                        // Pause the game - push to stack
-                        pauseStack.push(true);
-                        isPaused = true;
-                        backgroundMusic.pause();
-                     }
-                     else
-                     {
-                        // Resume the game - pop from stack
-                        if (!pauseStack.empty())
-                        {
-                           pauseStack.pop();
-                           isPaused = !pauseStack.empty();
-                           if (!isPaused)
-                           {
-                              backgroundMusic.play();
-                           }
-                        }
-                     }
-                  }
-               }
+               reference[a] = map_collision(0, use_door[a], speed[a] + x[a], y[a], map)
+                            | map_collision(0, use_door[a], x[a], y[a] - speed[a], map) << 1
+                            | map_collision(0, use_door[a], x[a] - speed[a], y[a], map) << 2
+                            | map_collision(0, use_door[a], x[a], speed[a] + y[a], map) << 3;
             }
-            
-            if (event.type == Event::KeyReleased)
+         }
+         else if (1 == kernel)
+         {
+            wall_bits.probe_all_scalar(x.data(), y.data(), speed.data(), use_door.data(), scalar.data(), count);
+         }
+         else
+         {
+            wall_bits.probe_all(x.data(), y.data(), speed.data(), use_door.data(), vector_walls.data(), count);
+         }
+      }
+
+      ns[kernel] = static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count()) / rounds / count;
+   }
+
+   unsigned short mismatches = 0;
+   for (unsigned short a = 0; a < count; a++)
+   {
+      mismatches += reference[a] != scalar[a] || reference[a] != vector_walls[a];
+   }
+
+#ifdef WALL_PROBE_AVX2
+   const char* vector_kernel = __builtin_cpu_supports("avx2") ? "avx2" : "scalar fallback";
+#else
+   const char* vector_kernel = "scalar fallback";
+#endif
+
+   std::cout << "Walls: map_collision " << ns[0] << " ns, bitboard " << ns[1] << " ns, " << vector_kernel << ' ' << ns[2]
+             << " ns per entity, " << mismatches << " mismatches in " << count << " entities\n";
+
+   return mismatches ? 1 : 0;
+}
+
+// the junction table against probing and targeting every ghost every tick, and the batched passes against
+// running every pass for one ghost at a time, run headless with --verify-junctions.
+// Pac-Man jumps between open tiles and eats an energizer now and then so every ghost mode gets exercised
+int run_junction_verification()
+{
+   const unsigned short counts[] = {4, 64};
+   const unsigned short seeds = 10;
+   const unsigned short ticks = 6000;
+
+   unsigned long reference_targets = 0;
+   unsigned long junction_targets = 0;
+   unsigned short runs = 0;
+
+   for (unsigned short count : counts)
+   {
+      for (unsigned short seed = 1; seed <= seeds; seed++)
+      {
+         array<Position, 4> ghost_positions;
+         Pacman reference_pacman;
+         array<array<Cell, MAP_HEIGHT>, MAP_WIDTH> map = convert_sketch(MAP_SKETCH, ghost_positions, reference_pacman);
+         Pacman junction_pacman = reference_pacman;
+         Pacman ordered_pacman = reference_pacman;
+
+         WallBitboard wall_bits;
+         wall_bits.build(map);
+         JunctionTable junctions;
+         junctions.build(map);
+         FlowField chase_field;
+         chase_field.build(map);
+
+         vector<Position> open_tiles;
+         for (unsigned char a = 0; a < MAP_WIDTH; a++)
+         {
+            for (unsigned char b = 0; b < MAP_HEIGHT; b++)
             {
-               if (event.key.code == Keyboard::P)
+               if (Cell::Wall != map[a][b] && Cell::Door != map[a][b])
                {
-                  pauseKeyPressed = false;
+                  open_tiles.push_back({static_cast<short>(CELL_SIZE * a), static_cast<short>(CELL_SIZE * b)});
                }
             }
          }
-         
-        
-         if (!window.isOpen()) {
-            break;
-         }
 
-        
-         static bool wasDead = false;
-         
-         if (pacman.get_dead() && !wasDead)
-         {
-           
-            backgroundMusic.stop();
-            deathMusic.play();
-            deathSoundPlayed = true;
-            wasDead = true;
-         }
+         GhostManager reference(count);
+         GhostManager junction(count);
+         GhostManager ordered(count);
+         reference.reset(LevelTable::defaults(0), ghost_positions);
+         junction.reset(LevelTable::defaults(0), ghost_positions);
+         ordered.reset(LevelTable::defaults(0), ghost_positions);
 
-       
-         if (pacman.get_dead() && pacman.get_animation_over())
+         unsigned short energizer_timer = 0;
+
+         for (unsigned short tick = 0; tick < ticks; tick++)
          {
-            
-            if (wasDead && lives > 0) {
-               lives--;
-               wasDead = false;  //reset the flag
+            if (0 == tick % 150)
+            {
+               const Position& tile = open_tiles[(seed * 7919u + tick / 150 * 104729u) % open_tiles.size()];
+               reference_pacman.set_position(tile.x, tile.y);
+               junction_pacman.set_position(tile.x, tile.y);
+               ordered_pacman.set_position(tile.x, tile.y);
             }
-            
-            if (lives > 0)
+
+            energizer_timer = 500 == tick % 2000 ? LevelTable::defaults(0).energizer_duration : energizer_timer ? energizer_timer - 1 : 0;
+            reference_pacman.set_energizer_timer(energizer_timer);
+            junction_pacman.set_energizer_timer(energizer_timer);
+            ordered_pacman.set_energizer_timer(energizer_timer);
+
+            // the same random numbers for both, frightened ghosts draw until they find a way out
+            chase_field.set_target(reference_pacman.get_position());
+
+            reference.seed(seed * 100000u + tick);
+            reference.update(wall_bits, nullptr, &chase_field, reference_pacman);
+            junction.seed(seed * 100000u + tick);
+            junction.update(wall_bits, &junctions, &chase_field, junction_pacman);
+            ordered.seed(seed * 100000u + tick);
+            ordered.update_one_by_one(wall_bits, nullptr, &chase_field, ordered_pacman);
+
+            if (!reference.same_state(junction))
             {
-               
-               map = convert_sketch(map_sketch, ghost_positions, pacman);
-               ghost_manager.reset(level, ghost_positions);
-               pacman.reset();
-               deathSoundPlayed = false;  
-               
-               
-               deathMusic.stop();
-               backgroundMusic.play();
+               std::cout << "Junctions: " << count << " ghosts, seed " << seed << ", tick " << tick << ": the junction table went a different way\n";
+               return 1;
             }
-            else
+
+            // both work out every target every tick, a flanker aiming from the wrong leader shows here first
+            if (!reference.same_state(ordered) || !reference.same_targets(ordered) || reference_pacman.get_dead() != ordered_pacman.get_dead())
             {
-               
+               std::cout << "Junctions: " << count << " ghosts, seed " << seed << ", tick " << tick << ": the passes went a different way than one ghost at a time\n";
+               return 1;
             }
          }
-         else if (!pacman.get_dead())
-         {
-            wasDead = false;  
-         }
 
-         // Only update game if not paused
-         if (!isPaused && !game_won && !pacman.get_dead())
-         {
-            game_won = 1;
+         reference_targets += reference.get_target_updates();
+         junction_targets += junction.get_target_updates();
+         runs++;
+      }
+   }
 
-            pacman.update(level, map, current_score, chompSound);
-            ghost_manager.update(level, map, pacman);
-            
-           
+   std::cout << "Junctions: " << runs << " runs of " << ticks << " ticks identical to the full logic and to one ghost at a time, targets worked out "
+             << junction_targets << " times instead of " << reference_targets << '\n';
 
-            for (const array<Cell, MAP_HEIGHT>& column : map)
-            {
-               for (const Cell& cell : column)
-               {
-                  if (Cell::Pellet == cell)
-                  {
-                     game_won = 0;
-                     break;
-                  }
-               }
+   return 0;
+}
 
-               if (!game_won)
-               {
-                  break;
-               }
-            }
+// everything decoded at startup, fonts and sounds first so the lobby can start right away
+constexpr unsigned char ASSET_LOADER_THREADS = 3;
+
+void queue_startup_assets(AssetLoader& loader)
+{
+   // without a packed atlas the small sheets are stitched on first use instead
+   if (asset_exists(ATLAS_FILE))
+   {
+      loader.add_image(ATLAS_FILE);
+   }
+
+   for (const char* file : AUDIO_SOUND_FILES)
+   {
+      loader.add_sound(file, 0);
+   }
+   for (const char* file : MUSIC_STREAM_FILES)
+   {
+      loader.add_sound(file, MUSIC_INTRO_SECONDS);
+   }
+
+   loader.add_image("Resources/Images/Lobby.jpg");
+   loader.add_image("Resources/Images/ViewScore.png");
+}
+
+// main function start ----//
+int main(int argc, char* argv[])
+{
+   StartupTimeline timeline;
+   timeline.mark("main");
+
+   // the linked bundle first, then a Resources.pak next to the executable, then loose files.
+   // Opened before the command line, the headless modes read the level table and sheets from it too
+   string executable = argv[0];
+   if (asset_bundle.open(ASSET_BUNDLE, ASSET_BUNDLE_SIZE) ||
+       asset_bundle.open_file(executable.substr(0, executable.find_last_of("/\\") + 1) + "Resources.pak"))
+   {
+      timeline.mark("asset bundle with " + to_string(asset_bundle.size()) + " files");
+   }
+
+   // create the score object for 
+   ScoreList score_list;  
+   
+   // leaderboard command line, see README
+   unique_ptr<LeaderboardClient> leaderboard;
+   for (int a = 1; a < argc; a++)
+   {
+      string arg = argv[a];
+      string value = a + 1 < argc ? argv[a + 1] : "";
+
+      if (arg == "--record" && !value.empty())
+      {
+         record_path = value;
+         a++;
+      }
+      else if (arg == "--scale" && !value.empty())
+      {
+         frame_scale = static_cast<unsigned char>(min(8, max(0, atoi(value.c_str()))));
+         a++;
+      }
+      else if (arg == "--replay" && !value.empty())
+      {
+         return run_replay(value);
+      }
+      else if (arg == "--leaderboard-server")
+      {
+         LeaderboardServer server("leaderboard.txt");
+         return server.run(value.empty() ? LEADERBOARD_PORT : static_cast<unsigned short>(atoi(value.c_str())));
+      }
+      else if (arg == "--leaderboard-top" || arg == "--leaderboard-rank")
+      {
+         IpAddress address;
+         unsigned short port;
+         parse_leaderboard_address(value.empty() ? "127.0.0.1" : value, address, port);
+         string query = a + 2 < argc ? argv[a + 2] : "";
 
-            if (game_won)
+         if (arg == "--leaderboard-top")
+         {
+            unsigned k = query.empty() ? 5 : static_cast<unsigned>(atoi(query.c_str()));
+            vector<pair<string, int>> rows = LeaderboardClient::query_top(address, port, k);
+            for (size_t i = 0; i < rows.size(); i++)
             {
-                   
-               pacman.set_animation_timer(0);
+               cout << i + 1 << ". " << rows[i].first << ' ' << rows[i].second << '\n';
             }
          }
-         else if (!isPaused && Keyboard::isKeyPressed(Keyboard::Enter))
+         else
          {
-            
-            if (pacman.get_dead() && pacman.get_animation_over())
-            {
-               if (lives == 0)
-               {
-                  
-                  score_list.add(player_name, current_score);
-                  save_score(player_name, current_score);
-                  current_score = 0;
-                  level = 0;
-                  lives = 3;  
-                  deathSoundPlayed = false;
-                  deathMusic.stop();
-                  window.close();
-                  break;
-               }
-               
-            }
-            else if (game_won)
-            {
-              // if all pellets eat then next level will come
-               game_won = 0;
-               level++;
-             
-               current_score += 5000;  // for every completing the 5000 bonus will be given
+            int score = 0;
+            unsigned total = 0;
+            unsigned rank = LeaderboardClient::query_rank(address, port, query, score, total);
+            if (rank) cout << query << " is #" << rank << " of " << total << " with " << score << '\n';
+            else cout << query << " has no score on the leaderboard\n";
+         }
+         return 0;
+      }
+      else if (arg == "--bench-ghosts")
+      {
+         return run_ghost_benchmark();
+      }
+      else if (arg == "--bench-flow-field")
+      {
+         return run_flow_field_benchmark();
+      }
+      else if (arg == "--bench-queues")
+      {
+         return run_queue_benchmark();
+      }
+      else if (arg == "--bench-raster")
+      {
+         return run_raster_benchmark(value.empty() ? "replays/demo.rec" : value);
+      }
+      else if (arg == "--bench-walls")
+      {
+         return run_wall_probe_benchmark();
+      }
+      else if (arg == "--verify-leaderboard")
+      {
+         return run_leaderboard_verification();
+      }
+      else if (arg == "--verify-junctions")
+      {
+         return run_junction_verification();
+      }
+      else if (arg == "--verify-pause")
+      {
+         return run_pause_verification(value.empty() ? "replays/demo.rec" : value);
+      }
+      else if (arg == "--leaderboard" && !value.empty())
+      {
+         IpAddress address;
+         unsigned short port;
+         parse_leaderboard_address(value, address, port);
+         leaderboard.reset(new LeaderboardClient(address, port));
+         leaderboard_client = leaderboard.get();
+         a++;
+      }
+   }
+   
+   
+   // decoding starts before the window so both overlap
+   AssetLoader loader(timeline);
+   queue_startup_assets(loader);
+   loader.start(ASSET_LOADER_THREADS);
+   asset_loader = &loader;
+   timeline.mark("loader started");
 
-               map = convert_sketch(map_sketch, ghost_positions, pacman);
-               ghost_manager.reset(level, ghost_positions);
-               pacman.reset();
-            }
+   load_scores_from_file(score_list);
+   
+   // one window for every screen, created once for the process
+   // any size works, the game is letterboxed at a whole scale and the menus keep their aspect
+   unsigned char window_scale = 0 < frame_scale ? frame_scale : SCREEN_RESIZE;
+   RenderWindow window(VideoMode(CELL_SIZE * MAP_WIDTH * window_scale, (FONT_HEIGHT + CELL_SIZE * MAP_HEIGHT) * window_scale), "Pac-Man", Style::Default);
+   timeline.mark("window created");
+   
+   // audio lives for the whole process, games only push events
+   AudioMixer audio_mixer;
+   AudioEventQueue audio_events;
+   MusicManager music;
+   
+   SceneStack scenes;
+   SceneContext context{window, scenes, music, score_list, "Player"};
+   LobbyScene lobby(context);
+   ScoresScene scores(context);
+   NameEntryScene name_entry(context);
+   GameScene game(context, audio_events);
+   PauseScene pause(context, game);
+
+   scenes.add(LobbyScreen, lobby);
+   scenes.add(ScoresScreen, scores);
+   scenes.add(NameEntryScreen, name_entry);
+   scenes.add(GameScreen, game);
+   scenes.add(PauseScreen, pause);
+   scenes.push(LobbyScreen);
+
+   bool first_frame = 0;
+   bool idle = 0;
+
+   while (window.isOpen())
+   {
+Event event;
+      // a screen with nothing new sleeps until input arrives or its wait runs out
+      bool pending = idle ? wait_event(window, event, scenes.top()->idle_wait()) : window.pollEvent(event);
+      bool exposed = 0;
+
+      for (; pending; pending = window.pollEvent(event))
+      {
+         // the window may have been covered, a sleeping screen draws itself again
+         exposed |= Event::GainedFocus == event.type || Event::Resized == event.type;
+
+         if (Event::Closed == event.type)
+         {
+            // exit hooks still run, a game in progress saves its score
+            scenes.clear();
+            window.close();
+            break;
          }
 
-         if (FRAME_DURATION > lag)
+         // menus keep their layout size in the new window, the game places its quad every frame.
+         // A render thread owns the window's view, so it is left alone then
+         if (Event::Resized == event.type && !scenes.top()->draws_itself())
          {
-         
-            bool is_game_over = pacman.get_dead() && pacman.get_animation_over() && lives == 0;
-            
-            if (is_game_over)
-            {
-               
-               window.clear(Color(135, 206, 250));  
-               backgroundMusic.stop();
-            }
-            else
-            {
-               window.clear();
-            }
+            set_scene_view(window, window.getView().getSize().x, window.getView().getSize().y);
+         }
 
-            if (!game_won && !pacman.get_dead())
-            {
-               draw_map(map, window); //display the score at end
-               ghost_manager.draw(GHOST_FLASH_START >= pacman.get_energizer_timer(), window);
-               draw_text(0, 0, CELL_SIZE * MAP_HEIGHT, "Level: " + to_string(1 + level), window);
-               
-               draw_text(0, 0, CELL_SIZE * MAP_HEIGHT + FONT_HEIGHT, "Score: " + to_string(current_score), window);
-               
-               draw_lives_hearts(lives, window);
-            }
+         scenes.top()->handle_event(event);
+      }
 
-            pacman.draw(game_won, window);
+      if (!window.isOpen())
+      {
+         break;
+      }
 
-            if (pacman.get_animation_over())
-            {
-               if (game_won)
-               {
-                  draw_text(1, 0, 0, "Next level!", window);
-               }
-               else if (lives == 0)
-               {
-                 
-Texture font_texture;
-                  font_texture.loadFromFile("Resources/Images/Font.png");
-                  unsigned char character_width = static_cast<unsigned char>(font_texture.getSize().x / 96);
-                  
-                  unsigned short screen_width = CELL_SIZE * MAP_WIDTH;
-                  unsigned short screen_height = CELL_SIZE * MAP_HEIGHT;
-                  
-                  
-                  unsigned short center_y = screen_height / 2;
-                  unsigned short line_spacing = FONT_HEIGHT * 8;  
-                  
-                 // gameover interefrence
-                  std::string gameOverText = "Game over";
-                  unsigned short gameOverX = (screen_width - gameOverText.length() * character_width) / 2;
-                  unsigned short gameOverY = center_y - line_spacing * 2;  
-                  draw_text(0, gameOverX, gameOverY, gameOverText, window);
-                  
-                  
-                  string finalScore = "Final Score: " + std::to_string(current_score);
-                  unsigned short scoreX = (screen_width - finalScore.length() * character_width) / 2;
-                  unsigned short scoreY = center_y - line_spacing / 2;  
-                  draw_text(0, scoreX, scoreY, finalScore, window);
-                  
-                 
-                  string playerInfo = "Player: " + player_name;
-                  unsigned short playerX = (screen_width - playerInfo.length() * character_width) / 2;
-                  unsigned short playerY = center_y + line_spacing / 2; 
-                  draw_text(0, playerX, playerY, playerInfo, window);
-                  
-                 
-                  string instructionText = "Press Enter to return";
-                  unsigned short instX = (screen_width - instructionText.length() * character_width) / 2;
-                  unsigned short instY = center_y + line_spacing * 2;  
-                  draw_text(0, instX, instY, instructionText, window);
-               }
-               else if (lives > 0)
-               {
-                  // lives for respawn pacman ko phirse zinda karo
-                  Texture font_texture;
-                  font_texture.loadFromFile("Resources/Images/Font.png");
-                  unsigned char character_width = static_cast<unsigned char>(font_texture.getSize().x / 96);
-                  
-                  unsigned short screen_width = CELL_SIZE * MAP_WIDTH;
-                  unsigned short screen_height = CELL_SIZE * MAP_HEIGHT;
-                  
-                  unsigned short center_y = screen_height / 2;
-                  
-                  string respawnText = "Lives left: " + std::to_string(lives);
-                  unsigned short respawnX = (screen_width - respawnText.length() * character_width) / 2;
-                  unsigned short respawnY = center_y - FONT_HEIGHT * 2;
-                  draw_text(0, respawnX, respawnY, respawnText, window);
-                  
-                  string pressEnterText = "Press Enter to continue";
-                  unsigned short enterX = (screen_width - pressEnterText.length() * character_width) / 2;
-                  unsigned short enterY = center_y;
-                  draw_text(0, enterX, enterY, pressEnterText, window);
-               }
-            }
-            
-            // Display pause menu if game is paused
-            if (isPaused)
-            {
-               Texture font_texture;
-               font_texture.loadFromFile("Resources/Images/Font.png");
-               unsigned char character_width = static_cast<unsigned char>(font_texture.getSize().x / 96);
-               
-               unsigned short screen_width = CELL_SIZE * MAP_WIDTH;
-               unsigned short screen_height = CELL_SIZE * MAP_HEIGHT;
-               
-               // Draw semi-transparent overlay
-               RectangleShape overlay;
-               overlay.setSize(Vector2f(screen_width, screen_height));
-               overlay.setFillColor(Color(0, 0, 0, 180));
-               window.draw(overlay);
-               
-               unsigned short center_y = screen_height / 2;
-               unsigned short line_spacing = FONT_HEIGHT * 4;
-               
-               // Pause text
-               string pauseText = "GAME PAUSED";
-               unsigned short pauseX = (screen_width - pauseText.length() * character_width) / 2;
-               unsigned short pauseY = center_y - line_spacing;
-               draw_text(0, pauseX, pauseY, pauseText, window);
-               
-               // Resume instruction
-               string resumeText = "Press P to Resume";
-               unsigned short resumeX = (screen_width - resumeText.length() * character_width) / 2;
-               unsigned short resumeY = center_y;
-               draw_text(0, resumeX, resumeY, resumeText, window);
-            }
+      bool uploaded = loader.upload_ready();
+      Scene* scene = scenes.top();
+
+      // fades and intro handoffs keep going while the screen sleeps
+      music.update();
+      idle = 0;
+
+      bool changed = scene->update() || uploaded || exposed;
+
+      if (changed)
+      {
+         audio_mixer.update(audio_events);
+      }
+
+      if (scene->draws_itself())
+      {
+         idle = Time::Zero < scene->idle_wait();
+      }
+      else if (changed)
+      {
+         scene->draw();
+         window.display();
+         scene->presented();
 
-            window.display();
+         if (!first_frame)
+         {
+            first_frame = 1;
+            timeline.mark("first frame");
+            std::cout << "Startup: first frame after " << timeline.elapsed_ms() << " ms, see startup.log\n";
          }
       }
+      else
+      {
+         idle = Time::Zero < scene->idle_wait();
+      }
    }
-}}
+
+   audio_mixer.stop_all();
+}
@@ -0,0 +1,114 @@
+// packs the game resources into one indexed blob, run by the MakeFile before compiling
+//
+//    pack_assets <output.cpp|output.pak> <files...>
+//
+// layout (little endian):
+//    "PMPK"  u32 count
+//    count * { u32 name_length, name, u32 offset, u32 size }
+//    file data, offsets count from the start of the blob
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+static void put_u32(vector<unsigned char>& out, uint32_t value)
+{
+   for (unsigned char a = 0; a < 4; a++)
+   {
+      out.push_back(static_cast<unsigned char>(value >> (8 * a)));
+   }
+}
+
+static void set_u32(vector<unsigned char>& out, size_t at, uint32_t value)
+{
+   for (unsigned char a = 0; a < 4; a++)
+   {
+      out[at + a] = static_cast<unsigned char>(value >> (8 * a));
+   }
+}
+
+int main(int argc, char* argv[])
+{
+   if (argc < 3)
+   {
+      cerr << "usage: pack_assets <output.cpp|output.pak> <files...>\n";
+      return 1;
+   }
+
+   string output = argv[1];
+   vector<string> names;
+   vector<vector<unsigned char>> contents;
+
+   for (int a = 2; a < argc; a++)
+   {
+      string name = argv[a];
+      for (char& c : name)
+      {
+         if ('\\' == c) c = '/';
+      }
+
+      ifstream ifs(argv[a], ios::binary);
+      if (!ifs.is_open())
+      {
+         cerr << "pack_assets: cannot read " << argv[a] << '\n';
+         return 1;
+      }
+
+      names.push_back(name);
+      contents.emplace_back(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+   }
+
+   vector<unsigned char> blob = {'P', 'M', 'P', 'K'};
+   put_u32(blob, static_cast<uint32_t>(names.size()));
+
+   vector<size_t> offset_fields;
+   for (const string& name : names)
+   {
+      put_u32(blob, static_cast<uint32_t>(name.size()));
+      blob.insert(blob.end(), name.begin(), name.end());
+      offset_fields.push_back(blob.size());
+      put_u32(blob, 0);
+      put_u32(blob, 0);
+   }
+
+   for (size_t a = 0; a < contents.size(); a++)
+   {
+      set_u32(blob, offset_fields[a], static_cast<uint32_t>(blob.size()));
+      set_u32(blob, offset_fields[a] + 4, static_cast<uint32_t>(contents[a].size()));
+      blob.insert(blob.end(), contents[a].begin(), contents[a].end());
+   }
+
+   bool pak = output.size() > 4 && output.compare(output.size() - 4, 4, ".pak") == 0;
+   ofstream ofs(output, ios::binary);
+
+   if (pak)
+   {
+      ofs.write(reinterpret_cast<const char*>(blob.data()), blob.size());
+   }
+   else
+   {
+      ofs << "// generated by pack_assets, do not edit\n";
+      ofs << "#include <cstddef>\n\n";
+      ofs << "extern const unsigned char ASSET_BUNDLE[] = {";
+
+      const char* digits = "0123456789abcdef";
+      for (size_t a = 0; a < blob.size(); a++)
+      {
+         ofs << (a % 24 ? "" : "\n   ") << "0x" << digits[blob[a] >> 4] << digits[blob[a] & 15] << ',';
+      }
+
+      ofs << "\n};\n\nextern const std::size_t ASSET_BUNDLE_SIZE = " << blob.size() << ";\n";
+   }
+
+   if (!ofs.good())
+   {
+      cerr << "pack_assets: cannot write " << output << '\n';
+      return 1;
+   }
+
+   cout << "pack_assets: " << names.size() << " files, " << blob.size() << " bytes -> " << output << '\n';
+   return 0;
+}
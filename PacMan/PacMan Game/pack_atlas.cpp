@@ -0,0 +1,154 @@
+// packs the sprite sheets into one atlas image and a header of where each sheet went, run by the MakeFile
+//
+//    pack_atlas <atlas.png> <header.hpp> <sheets...>
+//
+// sheets are laid on shelves tallest first, the atlas is as wide as the widest sheet
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <SFML/Graphics.hpp>
+
+using namespace std;
+using namespace sf;
+
+struct Sheet
+{
+   string file;
+   string name;
+   Image image;
+   IntRect rect;
+};
+
+// "Resources/Images/Map16.png" -> "ATLAS_MAP16"
+static string constant_name(const string& file)
+{
+   size_t begin = file.find_last_of("/\\");
+   begin = string::npos == begin ? 0 : 1 + begin;
+
+   size_t end = file.find_last_of('.');
+   if (string::npos == end || end < begin)
+   {
+      end = file.size();
+   }
+
+   string name = "ATLAS_";
+   for (size_t a = begin; a < end; a++)
+   {
+      name += isalnum(static_cast<unsigned char>(file[a])) ? static_cast<char>(toupper(static_cast<unsigned char>(file[a]))) : '_';
+   }
+
+   return name;
+}
+
+int main(int argc, char* argv[])
+{
+   if (argc < 4)
+   {
+      cerr << "usage: pack_atlas <atlas.png> <header.hpp> <sheets...>\n";
+      return 1;
+   }
+
+   vector<Sheet> sheets(argc - 3);
+   unsigned int width = 0;
+
+   for (int a = 3; a < argc; a++)
+   {
+      Sheet& sheet = sheets[a - 3];
+
+      sheet.file = argv[a];
+      for (char& c : sheet.file)
+      {
+         if ('\\' == c) c = '/';
+      }
+      sheet.name = constant_name(sheet.file);
+
+      if (!sheet.image.loadFromFile(argv[a]))
+      {
+         cerr << "pack_atlas: cannot read " << argv[a] << '\n';
+         return 1;
+      }
+
+      width = max(width, sheet.image.getSize().x);
+   }
+
+   vector<Sheet*> order;
+   for (Sheet& sheet : sheets)
+   {
+      order.push_back(&sheet);
+   }
+   stable_sort(order.begin(), order.end(), [](const Sheet* a, const Sheet* b) { return a->image.getSize().y > b->image.getSize().y; });
+
+   unsigned int x = 0;
+   unsigned int y = 0;
+   unsigned int shelf_height = 0;
+
+   for (Sheet* sheet : order)
+   {
+      Vector2u size = sheet->image.getSize();
+
+      if (x + size.x > width)
+      {
+         y += shelf_height;
+         x = 0;
+         shelf_height = 0;
+      }
+
+      sheet->rect = IntRect(x, y, size.x, size.y);
+      x += size.x;
+      shelf_height = max(shelf_height, size.y);
+   }
+
+   unsigned int height = y + shelf_height;
+
+   Image atlas;
+   atlas.create(width, height, Color::Transparent);
+   for (const Sheet& sheet : sheets)
+   {
+      atlas.copy(sheet.image, sheet.rect.left, sheet.rect.top);
+   }
+
+   if (!atlas.saveToFile(argv[1]))
+   {
+      cerr << "pack_atlas: cannot write " << argv[1] << '\n';
+      return 1;
+   }
+
+   ofstream ofs(argv[2]);
+
+   ofs << "// generated by pack_atlas, do not edit\n";
+   ofs << "#pragma once\n\n";
+   ofs << "#include <SFML/Graphics/Rect.hpp>\n\n";
+   ofs << "const unsigned short ATLAS_WIDTH = " << width << ";\n";
+   ofs << "const unsigned short ATLAS_HEIGHT = " << height << ";\n";
+   ofs << "const unsigned char ATLAS_SHEET_COUNT = " << sheets.size() << ";\n\n";
+
+   for (const Sheet& sheet : sheets)
+   {
+      ofs << "const sf::IntRect " << sheet.name << '(' << sheet.rect.left << ", " << sheet.rect.top << ", " << sheet.rect.width << ", " << sheet.rect.height << ");\n";
+   }
+
+   ofs << "\nconst char* const ATLAS_SHEET_FILES[ATLAS_SHEET_COUNT] = {\n";
+   for (const Sheet& sheet : sheets)
+   {
+      ofs << "   \"" << sheet.file << "\",\n";
+   }
+   ofs << "};\n\nconst sf::IntRect ATLAS_SHEET_RECTS[ATLAS_SHEET_COUNT] = {\n";
+   for (const Sheet& sheet : sheets)
+   {
+      ofs << "   " << sheet.name << ",\n";
+   }
+   ofs << "};\n";
+
+   if (!ofs.good())
+   {
+      cerr << "pack_atlas: cannot write " << argv[2] << '\n';
+      return 1;
+   }
+
+   cout << "pack_atlas: " << sheets.size() << " sheets, " << width << 'x' << height << " -> " << argv[1] << '\n';
+   return 0;
+}